@@ -43,6 +43,9 @@ public:
 
     // Read the content of the XML file of an algorithm with the given ID
     virtual std::wstring getAlgorithmInformationFileContent (const std::string &algorithmId) const override final;
+
+    // Return the path of a file in the cache directory
+    virtual std::string getCacheFilePath (const std::string &filename) const override final;
 };
 
 #endif // FILEMANAGERFORQT_H
@@ -53,6 +53,8 @@ void SettingsForQt::load() {
     mSoundGeneratorVolumeDynamic = mSettings.value("core/soundGeneratorVolumeDynamic", true).toBool();
     mStroboscopeActive = mSettings.value("core/stroboscopeMode", true).toBool();
     mDisableAutomaticKeySelection = mSettings.value("core/disableAutomaticKeySelection", false).toBool();
+    mFFTSizePolicy = static_cast<FFTSizePolicy>(
+                mSettings.value("core/fftSizePolicy", static_cast<int>(FFTSizePolicy::ZERO_PAD)).toInt());
 }
 
 qlonglong SettingsForQt::getApplicationRuns() const {
@@ -129,3 +131,8 @@ void SettingsForQt::setDisableAutomaticKeySelection(bool disable) {
     Settings::setDisableAutomaticKeySelection(disable);
     mSettings.setValue("core/disableAutomaticKeySelection", disable);
 }
+
+void SettingsForQt::setFFTSizePolicy(FFTSizePolicy policy) {
+    Settings::setFFTSizePolicy(policy);
+    mSettings.setValue("core/fftSizePolicy", static_cast<int>(policy));
+}
@@ -130,6 +130,7 @@ public:
     virtual void setSoundGeneratorVolumeDynamic(bool dynamic) override final;
     virtual void setStroboscopeMode(bool enable) override final;
     virtual void setDisableAutomaticKeySelection(bool disable) override final;
+    virtual void setFFTSizePolicy(FFTSizePolicy policy) override final;
 
 protected:
 private:
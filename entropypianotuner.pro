@@ -16,6 +16,11 @@ SUBDIRS = \
 app.depends = modules thirdparty
 modules.depends = thirdparty
 
+contains(EPT_CONFIG, tests) {
+    SUBDIRS += tests
+    tests.depends = modules thirdparty
+}
+
 # Global configuration
 DISTFILES += .qmake.conf
 
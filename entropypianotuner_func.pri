@@ -99,12 +99,19 @@ defineReplace(depends_dirent) {
 
 defineReplace(depends_fftw3) {
     fftw3 {
+        # The single precision library fftw3f is optional (EPT_FFTW3F),
+        # the bundled fftw3 provides it if FFTW_FLOAT_EXTERN_LIBS is set
         contains(EPT_THIRDPARTY_CONFIG, system_fftw3) {
-            LIBS += -lfftw3
+            LIBS += -lfftw3 -lfftw3f
+            DEFINES += EPT_FFTW3F
         } else {
             include($$EPT_THIRDPARTY_DIR/fftw3/fftw3_export.pri)
             INCLUDEPATH += $$FFTW_INCLUDE_PATHS
             LIBS += $$FFTW_LIB_PATH $$FFTW_EXTERN_LIBS
+            !isEmpty(FFTW_FLOAT_EXTERN_LIBS) {
+                LIBS += $$FFTW_FLOAT_EXTERN_LIBS
+                DEFINES += EPT_FFTW3F
+            }
         }
 
         # copy dlls or shared library
@@ -113,15 +120,19 @@ defineReplace(depends_fftw3) {
         } else {
             win32 {
                 DLLS += $$FFTW_DESTDIR/fftw3.dll
+                !isEmpty(FFTW_FLOAT_EXTERN_LIBS):DLLS += $$FFTW_DESTDIR/fftw3f.dll
             } else:android {
                 ANDROID_EXTRA_LIBS += $$FFTW_DESTDIR/libfftw3.so
+                !isEmpty(FFTW_FLOAT_EXTERN_LIBS):ANDROID_EXTRA_LIBS += $$FFTW_DESTDIR/libfftw3f.so
             } else:linux {
                 DLLS += $$FFTW_DESTDIR/libfftw3.so
+                !isEmpty(FFTW_FLOAT_EXTERN_LIBS):DLLS += $$FFTW_DESTDIR/libfftw3f.so
             }
         }
     }
 
     export(INCLUDEPATH)
+    export(DEFINES)
     export(LIBS)
     export(DLLS)
     export(ANDROID_EXTRA_LIBS)
@@ -21,6 +21,9 @@ else {
     EPT_CONFIG += shared_algorithms no_static_algorithms shared_core no_static_core
 }
 
+# the unit tests run on the build host only
+linux:!android:EPT_CONFIG += tests
+
 # add install rules
 winrt|winphone: EPT_CONFIG += no_install
 else: EPT_CONFIG += install
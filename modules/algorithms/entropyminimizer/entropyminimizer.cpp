@@ -55,6 +55,9 @@ EntropyMinimizer::EntropyMinimizer(const Piano &piano,
                                    const AlgorithmFactoryDescription &description) :
     Algorithm(piano, description),
     mAccumulator(NumberOfBins),
+    mSparseSpectra(),
+    mNorm(0),
+    mSumXLogX(0),
     mPitch(mNumberOfKeys),
     mInitialPitch(mNumberOfKeys),
     mRecalculateEntropy(false),
@@ -97,6 +100,8 @@ void EntropyMinimizer::algorithmWorkerFunction()
 
     if (success)
     {
+        buildSparseSpectra();
+
         LogI("Compute initial condition");
         ComputeInitialTuningCurve();
 
@@ -295,24 +300,60 @@ void EntropyMinimizer::updateTuningcurve ()
 void EntropyMinimizer:: clear()
 {
     mAccumulator.assign(NumberOfBins,0);
+    mNorm = 0;
+    mSumXLogX = 0;
     mPitch.assign(mNumberOfKeys,0);
     mInitialPitch.assign(mNumberOfKeys,0);
 }
 
 
 //-----------------------------------------------------------------------------
-//                   Truncate logspectrum at the cutoffs
+//                  Compress the spectra into sparse bands
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief  Truncate logspectrum at the cutoffs and return an element.
-/// \param spectrum : Logarithmically binned spectrum.
-/// \param m : Index of the element to be returned.
+/// \brief Build the sparse representation of all preprocessed spectra.
+///
+/// The logspectra are truncated at the cutoffs. Within the cutoffs, bins
+/// whose intensity is negligible compared to the maximum of the spectrum
+/// are dropped, and the remaining bins are grouped into contiguous bands.
+/// This function has to be called after the auditory preprocessing.
 ///////////////////////////////////////////////////////////////////////////////
 
-double EntropyMinimizer::getElement (SpectrumType &spectrum, int m)
+void EntropyMinimizer::buildSparseSpectra()
 {
-    return (m>mLowerCutoff and m<mUpperCutoff ? spectrum[m] : 0);
+    mSparseSpectra.resize(mNumberOfKeys);
+    size_t total = 0;
+    for (int k=0; k<mNumberOfKeys; ++k)
+    {
+        const SpectrumType &spectrum = mKeys[k].getSpectrum();
+        SparseSpectrum &sparse = mSparseSpectra[k];
+        sparse.bandBegin.clear();
+        sparse.bandOffset.clear();
+        sparse.values.clear();
+
+        const int mstart = mLowerCutoff+1;
+        const int mend = std::min<int>(mUpperCutoff, static_cast<int>(spectrum.size()));
+        double maximum = 0;
+        for (int m=mstart; m<mend; ++m) maximum = std::max(maximum, spectrum[m]);
+        const double threshold = 1E-10 * maximum;   // negligible intensity
+
+        for (int m=mstart; m<mend; ++m)
+        {
+            if (spectrum[m] <= threshold) continue;
+            // open a new band if the previous bin was negligible
+            if (m == mstart or spectrum[m-1] <= threshold)
+            {
+                sparse.bandBegin.push_back(m);
+                sparse.bandOffset.push_back(static_cast<int>(sparse.values.size()));
+            }
+            sparse.values.push_back(spectrum[m]);
+        }
+        sparse.bandOffset.push_back(static_cast<int>(sparse.values.size()));
+        total += sparse.values.size();
+    }
+    LogI("EntropyMinimizer: %d of %d spectral bins are relevant",
+         static_cast<int>(total), mNumberOfKeys * NumberOfBins);
 }
 
 
@@ -325,21 +366,37 @@ double EntropyMinimizer::getElement (SpectrumType &spectrum, int m)
 ///
 /// Since the entropy is computed from the accumulator, the accmulator values
 /// have a probability interpretation. Therfore, spectra should be added
-/// \param spectrum : Logarithmic spectrum
+///
+/// Only the bands of the sparse spectrum are visited, and the entropy sums
+/// are updated for the bins which actually change.
+/// \param spectrum : Sparse logarithmic spectrum
 /// \param shift : number of bins by which the spectrum is shifted
 /// \param intensity : weight at wich the spectrum is added (+) or subtracted (-).
 ///////////////////////////////////////////////////////////////////////////////
 
-void EntropyMinimizer::addToAccumulator (SpectrumType &spectrum,
+void EntropyMinimizer::addToAccumulator (const SparseSpectrum &spectrum,
                                          int shift, double intensity)
 {
-    for (int m=0; m<NumberOfBins; ++m)
+    const size_t bands = spectrum.bandBegin.size();
+    for (size_t b=0; b<bands; ++b)
     {
-        mAccumulator[m] += getElement(spectrum,m-shift) * intensity;
-        // Tiny negative values are possible and will be truncated here:
-        if (mAccumulator[m]<0 and mAccumulator[m]>-1E-10) mAccumulator[m] = 0;
-        // Larger negative values will lead to an exception
-        EptAssert(mAccumulator[m] >= 0,"negative intensities are inconsistent");
+        const int begin = spectrum.bandBegin[b] + shift;
+        const double *values = spectrum.values.data() + spectrum.bandOffset[b];
+        const int mstart = std::max(0, begin);
+        const int mend = std::min(NumberOfBins, begin + spectrum.bandOffset[b+1] - spectrum.bandOffset[b]);
+        for (int m=mstart; m<mend; ++m)
+        {
+            double &x = mAccumulator[m];
+            mNorm -= x;
+            mSumXLogX -= xlogx(x);
+            x += values[m-begin] * intensity;
+            // Tiny negative values are possible and will be truncated here:
+            if (x<0 and x>-1E-10) x = 0;
+            // Larger negative values will lead to an exception
+            EptAssert(x >= 0,"negative intensities are inconsistent");
+            mNorm += x;
+            mSumXLogX += xlogx(x);
+        }
     }
 }
 
@@ -353,8 +410,7 @@ void EntropyMinimizer::modifySpectralComponent (int keynumber,
 {
     EptAssert(keynumber>=0 and keynumber<mNumberOfKeys,"Range of parameter key");
 
-    Key &key = mKeys[keynumber];
-    SpectrumType &spectrum = key.getSpectrum();
+    const SparseSpectrum &spectrum = mSparseSpectra[keynumber];
     int  recorded_pitch  = getRecordedPitchET440AsInt(keynumber);
     int    old_pitchdiff = mPitch[keynumber] - recorded_pitch;
     int    new_pitchdiff = pitch             - recorded_pitch;
@@ -372,15 +428,17 @@ void EntropyMinimizer::modifySpectralComponent (int keynumber,
 void EntropyMinimizer::setAllSpectralComponents ()
 {
     mAccumulator.assign(NumberOfBins,0);
+    mNorm = 0;
+    mSumXLogX = 0;
     for (int k=0; k<mNumberOfKeys; ++k)
     {
-        Key &key = mKeys[k];
-        SpectrumType spectrum = key.getSpectrum();
+        const SparseSpectrum &spectrum = mSparseSpectra[k];
         int  recorded_pitch  = getRecordedPitchET440AsInt(k);
         int pitchdiff = mPitch[k] - recorded_pitch;
 
         addToAccumulator(spectrum,pitchdiff,1);
     }
+    updateEntropySums();
 }
 
 //-----------------------------------------------------------------------------
@@ -497,16 +555,39 @@ int EntropyMinimizer::getTolerance (int keynumber)
 //           Compute the entropy of the current accumulator content
 //-----------------------------------------------------------------------------
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Recompute the running entropy sums from the accumulator
+///
+/// The sums are updated incrementally by addToAccumulator. This function
+/// recomputes them from scratch in order to eliminate accumulated
+/// rounding errors.
+///////////////////////////////////////////////////////////////////////////////
+
+void EntropyMinimizer::updateEntropySums()
+{
+    mNorm = 0;
+    mSumXLogX = 0;
+    for (double x : mAccumulator)
+    {
+        mNorm += x;
+        mSumXLogX += xlogx(x);
+    }
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Compute the entropy of the current normalized accumulator content
+///
+/// With the norm N and S = sum x*log(x) the Shannon entropy of the
+/// normalized accumulator p=x/N is given by
+/// \f[ H = -\sum_m p_m \ln p_m = \ln N - S/N \,. \f]
 /// \return Numerical value of the entropy
 ///////////////////////////////////////////////////////////////////////////////
 
 double EntropyMinimizer::computeEntropy()
 {
-    SpectrumType copy(mAccumulator);            // get a local copy of the accumulator
-    MathTools::normalize(copy);                 // normalize it
-    return MathTools::computeEntropy(copy);     // return Shannon entropy
+    EptAssert (mNorm > 0, "Vectors with norm zero cannot be normalized");
+    return log(mNorm) - mSumXLogX / mNorm;
 }
 
 //-----------------------------------------------------------------------------
@@ -533,6 +614,7 @@ double EntropyMinimizer::computeEntropy()
 void EntropyMinimizer::minimizeEntropy ()
 {
     int cents=20; // even number which defines the width of the fluctuations
+    const uint64_t resyncInterval = 1000; // attempts between exact recomputations of the accumulator
 
     // Create random device for probabilistic seeding:
     std::random_device rd;
@@ -629,6 +711,13 @@ void EntropyMinimizer::minimizeEntropy ()
             if (progress > 1) break;
         }
 
+        // Eliminate rounding errors of the incremental updates from time to time
+        if (attemptsCounter % resyncInterval == 0)
+        {
+            setAllSpectralComponents();
+            H = computeEntropy();
+        }
+
         // If external manual change of tuning curve reset entropy
         if (mRecalculateEntropy)
         {
@@ -674,17 +763,10 @@ void EntropyMinimizer::minimizeEntropy ()
         else
         // (b) perform a Monte Carlo trial in which a whole section is moved by +/- 1.
         {
-            std::vector<int> savePitch(mPitch);
             int sign = (probdist(generator)<0.5 ? 1:-1);
-            if (keynumber < mKeyNumberOfA4)
-            {
-                for (int k=0; k<=keynumber; ++k) mPitch[k]+=sign;
-            }
-            else
-            {
-                for (int k=keynumber; k<mNumberOfKeys; ++k) mPitch[k]+=sign;
-            }
-            setAllSpectralComponents();
+            int first = (keynumber < mKeyNumberOfA4 ? 0 : keynumber);
+            int last = (keynumber < mKeyNumberOfA4 ? keynumber : mNumberOfKeys-1);
+            for (int k=first; k<=last; ++k) modifySpectralComponent(k,mPitch[k]+sign);
             double Hnew = computeEntropy();
             // If new entropy is lower accept the update, otherwise restore old situation
             if (Hnew < H)
@@ -694,8 +776,7 @@ void EntropyMinimizer::minimizeEntropy ()
             }
             else
             {
-                mPitch = savePitch;
-                setAllSpectralComponents();
+                for (int k=first; k<=last; ++k) modifySpectralComponent(k,mPitch[k]-sign);
             }
         }
     }
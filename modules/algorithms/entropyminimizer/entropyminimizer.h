@@ -40,6 +40,15 @@ ALGORITHM_H_START(entropyminimizer)
 /// computing the sum of all spectra after each Monte Carlo step again, we
 /// simply subtract the previous and add the new spectrum of the modified
 /// key alone.
+///
+/// Likewise, the entropy is not computed from the whole accumulator after
+/// each step. Instead, the norm and the sum of x*log(x) over all entries are
+/// updated together with the modified bins, from which the entropy of the
+/// normalized accumulator follows in closed form.
+///
+/// After preprocessing most bins of a spectrum are negligible. Each spectrum
+/// is therefore stored as a SparseSpectrum consisting of bands of relevant
+/// bins, so that the accumulator updates touch only these bands.
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -63,6 +72,14 @@ private:
     using Keys = Keyboard::Keys;
     const int NumberOfBins = Key::NumberOfBins;
 
+    /// Compressed spectrum, consisting of bands of non-negligible bins
+    struct SparseSpectrum
+    {
+        std::vector<int> bandBegin;     ///< Index of the first bin of each band
+        std::vector<int> bandOffset;    ///< Offset of each band in values, followed by values.size()
+        std::vector<double> values;     ///< Intensities of all bands, stored contiguously
+    };
+
 
 private:
 
@@ -70,21 +87,27 @@ private:
     static double ftom (double f) { return Key::FrequencyToRealIndex(f); }
     /// Convert array index in cent spacing to frequency in Hz
     static double mtof (int m)    { return Key::IndexToFrequency(m); }
+    /// Contribution of an unnormalized entry to the entropy sums
+    static double xlogx (double x) { return (x>0 ? x*log(x) : 0); }
 
     void updateTuningcurve (int keynumber);
     void updateTuningcurve ();
     void clear();
-    double getElement(SpectrumType &spectrum, int m);
-    void addToAccumulator (SpectrumType &spectrum, int shift, double intensity);
+    void buildSparseSpectra();
+    void addToAccumulator (const SparseSpectrum &spectrum, int shift, double intensity);
     void modifySpectralComponent (int key, int pitch);
     void setAllSpectralComponents();
     void addReferenceSpectrum (double intensity);
     int  getTolerance (int keynumber);
 
+    void updateEntropySums();
     double computeEntropy();
 
 private:
     SpectrumType mAccumulator;          ///< Accumulator holding the sum of all spectra
+    std::vector<SparseSpectrum> mSparseSpectra; ///< Spectra of the keys in compressed form
+    double mNorm;                       ///< Running sum of the accumulator entries
+    double mSumXLogX;                   ///< Running sum of x*log(x) over the accumulator entries
     std::vector<int> mPitch;            ///< Vector of pitches (in cents)
     std::vector<double>mInitialPitch;   ///< Vector of initial pitches
     int mLowerCutoff;                   ///< Lower cutoff for fluctuations
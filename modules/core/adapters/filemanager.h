@@ -87,6 +87,20 @@ public:
 
     virtual std::wstring getAlgorithmInformationFileContent (const std::string &algorithmId) const = 0;
 
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Abstract function: Get the standard path for cache files
+    ///
+    /// The tuner stores data which can be recomputed at any time, but whose
+    /// computation is expensive (e.g. the optimized FFT plans), in the
+    /// platform-dependent cache directory. This function has to be
+    /// implemented in the derived class.
+    /// \see FileManagerForQt
+    /// \param filename : The name of the cache file
+    /// \return Absolute path to the cache file
+    ///////////////////////////////////////////////////////////////////////////
+
+    virtual std::string getCacheFilePath (const std::string &filename) const = 0;
+
 private:
     static std::unique_ptr<FileManager> mSingleton; ///< Singleton unique pointer
 };
@@ -32,6 +32,11 @@
 #include "../system/eptexception.h"
 #include "../piano/piano.h"
 #include "../math/mathtools.h"
+#include "../math/simdtools.h"
+
+const double FFTAnalyzer::INHARMONICITY_SCAN_STEP = 1.06;
+const double FFTAnalyzer::INHARMONICITY_TOLERANCE = 1.002;
+const double FFTAnalyzer::MINIMAL_PEAK_AMPLITUDE = 1E-5;
 
 
 //-----------------------------------------------------------------------------
@@ -40,7 +45,7 @@
 
 FFTAnalyzer::FFTAnalyzer() :
     mOptimalSuperposition(),            // Array for peak superposition
-    mCurrentKernelKey(nullptr)          // Initially no kernel
+    mKernelCache()                      // Initially no kernels
 {}
 
 //-----------------------------------------------------------------------------
@@ -82,8 +87,8 @@ std::pair<FFTAnalyzerErrorTypes, std::shared_ptr<Key> > FFTAnalyzer::analyse (
     LogV("FFTAnalyzer started");
 
     // Map the final FFT to a logarithmically binned spectrum:
-    static SpectrumType spectrum(NumberOfBins);
-    constructLogBinnedSpectrum(finalFFT, spectrum);
+    const std::shared_ptr<const SpectrumType> logSpectrum = getLogBinnedSpectrum(finalFFT);
+    const SpectrumType &spectrum = *logSpectrum;
     Write("4-final-logspec.dat", spectrum);
 
     // In the first two octaves the ground frequency f1 is very weak
@@ -174,6 +179,33 @@ FrequencyDetectionResult FFTAnalyzer::detectFrequencyOfKnownKey (
         const Piano *piano,
         const Key &key,
         int keyIndex)
+{
+    // Create a shared pointer in which the result will be stored:
+    FrequencyDetectionResult result = std::make_shared<FrequencyDetectionResultStruct>();
+    detectFrequencyOfKnownKey(finalFFT, piano, key, keyIndex, *result);
+    return result;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Determine the frequency of a known key, storing the result in a
+/// given structure.
+///
+/// The structure is reset before. Its tuning deviation curve keeps its
+/// memory, so that a recycled result can be filled without allocations.
+/// \param finalFFT : Data of the fourier transform
+/// \param piano : Pointer to the piano
+/// \param key : The key to be tuned
+/// \param keyIndex : Index of the key
+/// \param result : Structure receiving the result
+///////////////////////////////////////////////////////////////////////////////
+
+void FFTAnalyzer::detectFrequencyOfKnownKey (
+        FFTDataPointer finalFFT,
+        const Piano *piano,
+        const Key &key,
+        int keyIndex,
+        FrequencyDetectionResultStruct &result)
 {
     // consisty check
     EptAssert(piano, "Piano has to be set");
@@ -181,8 +213,12 @@ FrequencyDetectionResult FFTAnalyzer::detectFrequencyOfKnownKey (
     EptAssert(finalFFT->isValid(), "The FFT data is not valid");
     EptAssert(keyIndex >= 0, "The final key has to be set.");
 
-    // Create a shared pointer in which the result will be stored:
-    FrequencyDetectionResult result = std::make_shared<FrequencyDetectionResultStruct>();
+    result.error = FFTAnalyzerErrorTypes::ERR_NONE;
+    result.tuningDeviationCurve.clear();
+    result.deviationInCents = 0;
+    result.overpullInCents = 0;
+    result.positionOfMaximum = 0;
+    result.detectedFrequency = -1;
 
     // This is the frequency to which we would like to tune the string
     double targetFrequency = piano->getConcertPitch()/440.0 *
@@ -190,68 +226,72 @@ FrequencyDetectionResult FFTAnalyzer::detectFrequencyOfKnownKey (
 
     if (targetFrequency <= 20 or targetFrequency > 10000)
     {
-        result->error = FFTAnalyzerErrorTypes::ERR_NO_COMPUTED_FREQUENCY;
-        return result;
+        result.error = FFTAnalyzerErrorTypes::ERR_NO_COMPUTED_FREQUENCY;
+        return;
     }
 
     // Define the frequency which corresponds to the middle of the array
-    double centerFrequency = key.getRecordedFrequency();
-    if (centerFrequency<=10) centerFrequency = targetFrequency;
-
-    // Map the final FFT to a logarithmically binned spectrum:
-    SpectrumType spectrum(NumberOfBins);
-    constructLogBinnedSpectrum(finalFFT, spectrum);
+    const double centerFrequency = getCenterFrequency(piano, key);
 
     // Define the search size around the center frequency in cents
-    const int searchSize = 200;
-    TuningDeviationCurveType out(searchSize), zoomedPeak (searchSize);
+    const int searchSize = TUNING_SEARCH_SIZE;
+    TuningDeviationCurveType &out = result.tuningDeviationCurve;
 
 
     // First method: Simply magnify the lowest peak
     if (not key.isRecorded())
     {
         double maximum = 0;
-        double middle = centerFrequency;
-        if (piano->getKeyboard().getKeyNumberOfA4()-keyIndex > 24)
+        const double middle = getZoomFrequency(piano, keyIndex, centerFrequency);
+
+        // A partial of amplitude a in a signal of n samples has an intensity
+        // of about (a*n/2)^2 in the Fourier transform. If no linear bin covered by
+        // the band reaches this intensity for MINIMAL_PEAK_AMPLITUDE, there
+        // is no peak to be magnified. The threshold does not depend on the
+        // rest of the spectrum, so that its norm is not needed.
+        const int firstIndex = static_cast<int>(std::floor(Key::FrequencyToRealIndex(middle))) - searchSize/2;
+        const FFTWVector &fft = finalFFT->fft;
+        const double b = 2.0 * fft.size() / finalFFT->samplingRate;
+        const size_t lower = static_cast<size_t>(std::max(0.0, b * Key::IndexToFrequency(firstIndex)));
+        const size_t upper = std::min(fft.size(), static_cast<size_t>(b * Key::IndexToFrequency(firstIndex + searchSize)) + 2);
+        const double threshold = std::pow(MINIMAL_PEAK_AMPLITUDE * finalFFT->getTime() * finalFFT->samplingRate / 2, 2);
+        if (lower >= upper or *std::max_element(fft.begin() + lower, fft.begin() + upper) < threshold)
         {
-            double B = piano->getExpectedInharmonicity(centerFrequency);
-            middle *= 2 * sqrt((1+4*B)/(1+B));
+            result.error = FFTAnalyzerErrorTypes::ERR_NO_PEAK_AMPLITUDE;
+            return;
         }
 
+        // Only the band around the peak is mapped to logarithmic bins
+        mBand.resize(searchSize);
+        constructLogBinnedBand(finalFFT, firstIndex, mBand);
+        out.resize(searchSize);
         for (int i=0; i<searchSize; ++i)
         {
-            int m = Key::FrequencyToRealIndex(middle) - searchSize/2 + i;
-            if (m>0 and m<static_cast<int>(spectrum.size()))
-            {
-                double value = spectrum[m] * spectrum[m];
-                if (value > maximum) maximum = value;
-                zoomedPeak[i] = value;
-            }
+            double value = mBand[i] * mBand[i];
+            if (value > maximum) maximum = value;
+            out[i] = value;
         }
-        if (maximum < 1E-15)
+        if (maximum <= 0)
         {
-            result->error = FFTAnalyzerErrorTypes::ERR_NO_PEAK_AMPLITUDE;
-            return result;
+            result.error = FFTAnalyzerErrorTypes::ERR_NO_PEAK_AMPLITUDE;
+            return;
         }
-        for (auto &element : zoomedPeak) element /= maximum;
-        out = std::move(zoomedPeak);
+        for (auto &element : out) element /= maximum;
     }
 
     // else if the key has been recorded explicitely we use the method developed
     // by Christoph. It uses an inverse kernel convolution
     else
     {
+        // The correlation with the kernel requires the complete
+        // logarithmically binned spectrum
+        const std::shared_ptr<const SpectrumType> spectrum = getLogBinnedSpectrum(finalFFT);
 
-
-        // create the kernel of the key, if the key changed
-        if (&key != mCurrentKernelKey)
-        {
-            mCurrentKernel = constructKernel(key.getSpectrum());
-            mCurrentKernelKey = &key;
-        }
+        // get the kernel of the key, it is only constructed if the spectrum changed
+        KernelCache::KernelPointer kernelFFT = mKernelCache.getKernelFFT(keyIndex, key.getSpectrum());
 
         // compute the deviation
-        out = computeTuningDeviation(mCurrentKernel, spectrum, searchSize);
+        computeTuningDeviation(*kernelFFT, *spectrum, searchSize, out);
     }
 
     int maxIndex = MathTools::findMaximum(out);
@@ -264,22 +304,106 @@ FrequencyDetectionResult FFTAnalyzer::detectFrequencyOfKnownKey (
     int computedIndex = MathTools::roundToInteger(log(targetFrequency / centerFrequency) * 1200 / MathTools::LOG2);
 
 
-    result->deviationInCents = static_cast<int>(index - computedIndex);
-    result->detectedFrequency = detectedFrequency;
-    result->positionOfMaximum = index;
-    result->tuningDeviationCurve = std::move(out);
+    result.deviationInCents = static_cast<int>(index - computedIndex);
+    result.detectedFrequency = detectedFrequency;
+    result.positionOfMaximum = index;
 
-    LogV("Deviation %d, comp index %d", result->deviationInCents, computedIndex);
+    LogV("Deviation %d, comp index %d", result.deviationInCents, computedIndex);
+}
 
-    return result;
+//-----------------------------------------------------------------------------
+//             Frequencies used for the detection of a known key
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the frequency corresponding to the middle of the tuning
+/// deviation curve.
+/// \param piano : Pointer to the piano
+/// \param key : The key to be tuned
+/// \return Recorded frequency of the key, or its target frequency if the
+/// key has not been recorded.
+///////////////////////////////////////////////////////////////////////////////
+
+double FFTAnalyzer::getCenterFrequency (const Piano *piano, const Key &key)
+{
+    double centerFrequency = key.getRecordedFrequency();
+    if (centerFrequency<=10)
+        centerFrequency = piano->getConcertPitch()/440.0 * key.getComputedFrequency();
+    return centerFrequency;
 }
 
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the frequency of the peak which is magnified if the key has
+/// not been recorded.
+///
+/// In the bass the first partial is weak, therefore the second partial
+/// is used for keys more than two octaves below A4.
+/// \param piano : Pointer to the piano
+/// \param keyIndex : Index of the key
+/// \param centerFrequency : Frequency of the first partial
+/// \return Frequency of the partial to be magnified
+///////////////////////////////////////////////////////////////////////////////
+
+double FFTAnalyzer::getZoomFrequency (const Piano *piano, int keyIndex, double centerFrequency)
+{
+    double middle = centerFrequency;
+    if (piano->getKeyboard().getKeyNumberOfA4()-keyIndex > 24)
+    {
+        double B = piano->getExpectedInharmonicity(centerFrequency);
+        middle *= 2 * sqrt((1+4*B)/(1+B));
+    }
+    return middle;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the highest frequency needed by detectFrequencyOfKnownKey.
+///
+/// The SignalAnalyzer uses this bandwidth to reduce the sampling rate of
+/// the rolling FFTs in the tuning mode. If the key has not been recorded
+/// only the band around a single partial is needed. Otherwise the spectrum
+/// is correlated with the recorded spectrum of the key, so that the
+/// bandwidth is given by the highest bin carrying a relevant part of the
+/// recorded spectrum. In both cases the search range of the tuning
+/// deviation is added as a margin.
+/// \param piano : Pointer to the piano
+/// \param key : The key to be tuned
+/// \param keyIndex : Index of the key
+/// \return Required bandwidth in Hz
+///////////////////////////////////////////////////////////////////////////////
+
+double FFTAnalyzer::getRequiredBandwidth (const Piano *piano, const Key &key, int keyIndex)
+{
+    EptAssert(piano, "Piano has to be set");
+    const double fullBandwidth = Key::IndexToFrequency(NumberOfBins);
+    const double margin = std::pow(2.0, TUNING_SEARCH_SIZE / 1200.0);
+    double frequency = 0;
+    if (not key.isRecorded())
+    {
+        frequency = getZoomFrequency(piano, keyIndex, getCenterFrequency(piano, key));
+    }
+    else
+    {
+        const double relevance = 1E-3;      // relative intensity of a relevant bin
+        const SpectrumType &spectrum = key.getSpectrum();
+        if (spectrum.empty()) return fullBandwidth;
+        const double maximum = *std::max_element(spectrum.begin(), spectrum.end());
+        int m = static_cast<int>(spectrum.size()) - 1;
+        while (m > 0 and spectrum[m] <= relevance * maximum) --m;
+        frequency = Key::IndexToFrequency(m);
+    }
+    if (frequency <= 0) return fullBandwidth;
+    return std::min(fullBandwidth, frequency * margin);
+}
+
+
 //-----------------------------------------------------------------------------
 //                 Construct logarithmically binned spectrum
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Construct logarithmically binned spectrum from the mFinalFFT.
+/// \brief Get the logarithmically binned spectrum of a Fourier transform.
 ///
 /// The FFT analysis yields a Fourier transform with an index which is linear
 /// in the frequency. For the tuning process, however, we need a spectrum
@@ -289,46 +413,117 @@ FrequencyDetectionResult FFTAnalyzer::detectFrequencyOfKnownKey (
 /// The dimension NumberOfBins is copied from the constant in class Key.
 /// The actual map between the indices can be found in Key::IndexToFrequency.
 ///
+/// The spectrum is cached in the FFTData. It is computed only once, even
+/// if the same Fourier transform is analyzed several times.
+///
 /// \param fftData Data of the fourier transform
-/// \param spectrum Vector holding the logarithmically binned spectrum.
+/// \return Shared pointer to the logarithmically binned spectrum.
 ///////////////////////////////////////////////////////////////////////////////
 
-void FFTAnalyzer::constructLogBinnedSpectrum(FFTDataPointer fftData, SpectrumType &spectrum)
+std::shared_ptr<const FFTAnalyzer::SpectrumType> FFTAnalyzer::getLogBinnedSpectrum(FFTDataPointer fftData)
 {
-    const double b = 2.0 * fftData->fft.size() / fftData->samplingRate;
-    std::function<double(double)> mtoq = [b] (double m)
-             { return b * Key::IndexToFrequency(m); };
-    MathTools::coarseGrainSpectrum (fftData->fft,spectrum,mtoq,0.25);
-    MathTools::normalize(spectrum);
+    return fftData->products.get<SpectrumType>("FFTAnalyzer::LogBinnedSpectrum",
+        [fftData] (SpectrumType &spectrum)
+    {
+        getLogBinningPlan(*fftData)->apply(fftData->fft, spectrum);
+        MathTools::normalize(spectrum);
+    }, mSpectrumPool);
 }
 
-FFTAnalyzer::SpectrumType FFTAnalyzer::constructKernel(const SpectrumType &originalSpectrum)
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the plan mapping a Fourier transform to the logarithmically
+/// binned spectrum.
+///
+/// The plan depends only on the size and the sampling rate of the
+/// transform. It is shared by all FFTs of the same kind.
+/// \param fftData : Data of the fourier transform
+/// \return Shared pointer to the plan
+///////////////////////////////////////////////////////////////////////////////
+
+CoarseGrainPlan::Pointer FFTAnalyzer::getLogBinningPlan (const FFTData &fftData)
 {
-    SpectrumType kernel(NumberOfBins);
-    FFTComplexVector fftOfOriginal;
-    mFFT.calculateFFT(originalSpectrum, fftOfOriginal);
-    for (FFTComplexType &c : fftOfOriginal) {
-        c = c / (c.real() * c.real() + c.imag() * c.imag());
-    }
-    mFFT.calculateFFT(fftOfOriginal, kernel);
-    return kernel;
+    const size_t size = fftData.fft.size();
+    const int samplingRate = fftData.samplingRate;
+    return CoarseGrainPlan::get("FFTAnalyzer::LogBinning", size, samplingRate, 0.25, [size, samplingRate] ()
+    {
+        const double b = 2.0 * size / samplingRate;
+        return CoarseGrainPlan::computeBoundaries(Key::NumberOfBins, [b] (double m)
+                 { return b * Key::IndexToFrequency(m); });
+    });
 }
 
-TuningDeviationCurveType FFTAnalyzer::computeTuningDeviation(
-        const SpectrumType &kernel, const SpectrumType &signal, int searchSize)
+
+//-----------------------------------------------------------------------------
+//           Construct a band of the logarithmically binned spectrum
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Construct a band of the logarithmically binned spectrum.
+///
+/// In the tuning mode often only a narrow band around a single partial is
+/// needed. This function maps only the bins firstIndex...firstIndex+size-1
+/// of the logarithmically binned spectrum, where size is the size of the
+/// band vector. The values coincide with the corresponding components of
+/// getLogBinnedSpectrum before normalization, but the cost is
+/// proportional to the width of the band instead of NumberOfBins.
+/// Bins outside the range of the full spectrum are set to zero.
+///
+/// \param fftData : Data of the fourier transform
+/// \param firstIndex : Index of the first bin of the band
+/// \param band : Vector of a given size holding the band.
+///////////////////////////////////////////////////////////////////////////////
+
+void FFTAnalyzer::constructLogBinnedBand(FFTDataPointer fftData, int firstIndex, SpectrumType &band)
 {
-    const int searchOffset = searchSize / 2;
-    TuningDeviationCurveType out(searchSize);
+    std::fill(band.begin(), band.end(), 0);
+    const int size = static_cast<int>(band.size());
+    const int first = std::max(firstIndex, 1);
+    const int last = std::min(firstIndex + size, NumberOfBins);
+    if (first >= last) return;
 
-    // in a range of 50 ct find the maximum when folding the kernel with the spectrum
-    for (int j = -searchOffset; j < searchSize - searchOffset; j++) {
-        out[j + searchOffset] = 0;
-        for (int i = 0; i < NumberOfBins; i++) {
-            out[j + searchOffset] += kernel[(i - j + NumberOfBins) % NumberOfBins] * signal[i];
-        }
-    }
+    getLogBinningPlan(*fftData)->apply(fftData->fft, band.data() + (first - firstIndex), first, last);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the tuning deviation curve by correlating the kernel of
+/// the key with the current spectrum.
+///
+/// The curve is the circular cross-correlation
+/// out[j] = sum_i kernel[(i-j) mod N] * signal[i] for shifts j in the
+/// range [-searchSize/2, searchSize/2). Instead of evaluating the sum
+/// directly for each shift, the full correlation is computed in Fourier
+/// space as the inverse transform of FFT(signal) * conj(FFT(kernel)),
+/// where the transform of the kernel is taken from the KernelCache.
+/// This reduces the cost from searchSize*N to O(N log N) operations.
+///
+/// \param kernelFFT : Fourier transform of the kernel of the key
+/// \param signal : Logarithmically binned spectrum of the current signal
+/// \param searchSize : Number of shifts (in cents) to be evaluated
+/// \param out : Correlation as a function of the shift
+///////////////////////////////////////////////////////////////////////////////
 
-    return out;
+void FFTAnalyzer::computeTuningDeviation(
+        const FFTComplexVector &kernelFFT, const SpectrumType &signal, int searchSize,
+        TuningDeviationCurveType &out)
+{
+    EptAssert(signal.size() == static_cast<size_t>(NumberOfBins), "Wrong spectrum size");
+    EptAssert(kernelFFT.size() == signal.size() / 2 + 1, "Wrong size of the kernel transform");
+    EptAssert(searchSize > 0 and searchSize < NumberOfBins, "Invalid search size");
+
+    // correlation in Fourier space, including the normalization of the backward FFT
+    mFFT.calculateFFT(signal, mCorrelationFFT);
+    SimdTools::multiplyConjugate(mCorrelationFFT.data(), kernelFFT.data(), mCorrelationFFT.data(),
+                                 mCorrelationFFT.size(), 1.0 / NumberOfBins);
+    mFFT.calculateFFT(mCorrelationFFT, mCorrelation);
+
+    // in a range of 50 ct extract the band of shifts, negative shifts wrap around
+    const int searchOffset = searchSize / 2;
+    out.resize(searchSize);
+    std::copy(mCorrelation.end() - searchOffset, mCorrelation.end(), out.begin());
+    std::copy(mCorrelation.begin(), mCorrelation.begin() + (searchSize - searchOffset),
+              out.begin() + searchOffset);
 }
 
 //-----------------------------------------------------------------------------
@@ -506,13 +701,15 @@ double FFTAnalyzer::getExpectedInharmonicity (double f)
 /// by determineFrequency. The frequency and inhamronicity is then optimized
 /// iteratively. This is achieved by minimizing the Renyi entropy of the
 /// collapsed peak according to the known inharmonicity formula.
+/// A coarse geometric scan locates the minimum, which is then refined
+/// by a golden-section search in log(B).
 ///
 /// \param spectrum : Logarithmically binned spectrum
 /// \param f : Previous frequency estimate
 /// \return Estimated inharmonicity coefficient B (dimensionless).
 ///////////////////////////////////////////////////////////////////////////////
 
-double FFTAnalyzer::estimateInharmonicity (FFTDataPointer fftData, SpectrumType &spectrum, double f)
+double FFTAnalyzer::estimateInharmonicity (FFTDataPointer fftData, const SpectrumType &spectrum, double f)
 {
     // do not evaluate inharmonicity if parameters are invalid
     if (spectrum.size()==0 or f<20) return 0;
@@ -540,45 +737,46 @@ double FFTAnalyzer::estimateInharmonicity (FFTDataPointer fftData, SpectrumType
     // Define the number of partials taken into accout.
     int N=MathTools::roundToInteger(4*(8-log(f)));
 
-    double B = 0;               // Inharmonicity to be determined
-    double Hmin = 1E100;        // Initial Renyi entropy very high
-    const int R = 80;           // width of the observation window in cents
-
     // Calling this function gives a first rough estimate of the inharmonicty
     double expected_B = getExpectedInharmonicity(f);
     LogV("FFTAnalyzer: expected B = %f", expected_B);
 
+    // The scan only reads windows of the squared spectrum, square it once
+    mSquaredSpectrum.resize(spectrum.size());
+    for (size_t m=0; m<spectrum.size(); ++m) mSquaredSpectrum[m] = spectrum[m]*spectrum[m];
+    mSuperposition.resize(INHARMONICITY_WINDOW);
     mOptimalSuperposition.clear();
-    for (double scan_B = expected_B/5; scan_B <= expected_B*5; scan_B*=1.03)
+
+    double B = 0;               // Inharmonicity to be determined
+    double Hmin = 1E100;        // Initial Renyi entropy very high
+    auto evaluate = [this,f,N,&B,&Hmin] (double scan_B)
     {
-        SpectrumType superposition(R,0);
-        for (int n=1; n<=N; ++n)
-        {
-            double fn = n*f*sqrt((1+scan_B*n*n)/(1+scan_B));
-            double mn = Key::FrequencyToRealIndex(fn);
-            SpectrumType partialspectrum(R,0);
-            if (mn-R/2>0 and mn+R/2<NumberOfBins)
-            {
-                for (int r=0; r<R; r++)
-                {
-                    int m = static_cast<int>(mn+r-R/2);
-                    EptAssert (m>=0 and m<NumberOfBins,"m invalid");
-                    partialspectrum[r]=pow(spectrum[m],2);
-                }
-                MathTools::normalize(partialspectrum);
-                for (int r=0; r<R; r++) superposition[r]+=partialspectrum[r];
-            }
-        }
+        double H = computeSuperpositionEntropy(f, N, scan_B, mSuperposition);
+        if (H<Hmin) { Hmin=H; B=scan_B; }
+        return H;
+    };
+
+    // Coarse geometric scan from expected_B/5 to 5*expected_B
+    const double step = INHARMONICITY_SCAN_STEP;
+    for (double scan_B = expected_B/5; scan_B <= expected_B*5; scan_B*=step) evaluate(scan_B);
 
-        MathTools::normalize(superposition);
-        double H = MathTools::computeRenyiEntropy(superposition,0.1);
-        if (fabs(H)<Hmin)
+    // Golden-section search in log(B) between the neighbors of the minimum
+    if (B > 0)
+    {
+        const double golden = (sqrt(5.0)-1)/2;
+        double a = log(B/step), b = log(B*step);
+        double x1 = b-golden*(b-a), x2 = a+golden*(b-a);
+        double H1 = evaluate(exp(x1)), H2 = evaluate(exp(x2));
+        while (b-a > log(INHARMONICITY_TOLERANCE))
         {
-            Hmin=H;
-            B=scan_B;
-            mOptimalSuperposition = superposition;
-            Write("7-find-inharmonicity.dat",superposition);
+            if (H1 < H2) { b=x2; x2=x1; H2=H1; x1=b-golden*(b-a); H1=evaluate(exp(x1)); }
+            else         { a=x1; x1=x2; H1=H2; x2=a+golden*(b-a); H2=evaluate(exp(x2)); }
         }
+
+        // keep the superposition of the best candidate for the quality checks
+        computeSuperpositionEntropy(f, N, B, mSuperposition);
+        mOptimalSuperposition = mSuperposition;
+        Write("7-find-inharmonicity.dat",mOptimalSuperposition);
     }
     LogV("FFTAnalyzer: finished estimating inharmonicity: B = %f", B);
 
@@ -590,6 +788,47 @@ double FFTAnalyzer::estimateInharmonicity (FFTDataPointer fftData, SpectrumType
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the entropy of the superposition of the partials for a
+/// given inharmonicity.
+///
+/// The windows of the squared spectrum (mSquaredSpectrum) around the
+/// expected positions of the partials are normalized individually and
+/// added. The Renyi entropy of the normalized superposition is small if
+/// the partials coincide, i.e., if B is close to the actual inharmonicity.
+/// No memory is allocated.
+/// \param f : Frequency of the first partial
+/// \param N : Number of partials taken into account
+/// \param B : Inharmonicity to be tested
+/// \param superposition : Vector receiving the normalized superposition,
+/// its size defines the width of the window in cents
+/// \return Renyi entropy, or a very large value if no partial is found
+///////////////////////////////////////////////////////////////////////////////
+
+double FFTAnalyzer::computeSuperpositionEntropy (double f, int N, double B, SpectrumType &superposition)
+{
+    const int R = static_cast<int>(superposition.size());
+    std::fill(superposition.begin(), superposition.end(), 0);
+    for (int n=1; n<=N; ++n)
+    {
+        double fn = n*f*sqrt((1+B*n*n)/(1+B));
+        double mn = Key::FrequencyToRealIndex(fn);
+        if (mn-R/2>0 and mn+R/2<NumberOfBins)
+        {
+            const double *partial = mSquaredSpectrum.data() + static_cast<int>(mn-R/2);
+            double norm = 0;
+            for (int r=0; r<R; ++r) norm += partial[r];
+            if (norm <= 0) continue;
+            for (int r=0; r<R; ++r) superposition[r] += partial[r] / norm;
+        }
+    }
+    double norm = MathTools::computeNorm(superposition);
+    if (norm <= 0) return std::numeric_limits<double>::max();
+    for (auto &x : superposition) x /= norm;
+    return fabs(MathTools::computeRenyiEntropy(superposition,0.1));
+}
+
+
 //-----------------------------------------------------------------------------
 //                  estimate quality of the recorded sound
 //-----------------------------------------------------------------------------
@@ -710,7 +949,7 @@ FFTAnalyzer::PeakListType FFTAnalyzer::identifyPeaks (FFTDataPointer fftData,
 //	   Write function for development purposes, not active in the release
 //-----------------------------------------------------------------------------
 
-void FFTAnalyzer::Write(std::string filename, SpectrumType &v)
+void FFTAnalyzer::Write(std::string filename, const SpectrumType &v)
 {
 #if CONFIG_ENABLE_XMGRACE
     std::ofstream os(filename);
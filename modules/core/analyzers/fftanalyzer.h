@@ -26,9 +26,12 @@
 
 #include "prerequisites.h"
 #include "fftanalyzererrorcodes.h"
+#include "kernelcache.h"
 #include "../piano/piano.h"
 #include "../math/fftadapter.h"
 #include "../math/fftimplementation.h"
+#include "../math/coarsegrainplan.h"
+#include "../system/objectpool.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Module performing the final analysis of the Fourier transform
@@ -59,20 +62,45 @@ public:
             const Key &key,
             int keyIndex);
 
+    void detectFrequencyOfKnownKey(
+            FFTDataPointer finalFFT,
+            const Piano *piano,
+            const Key &key,
+            int keyIndex,
+            FrequencyDetectionResultStruct &result);
+
+    double getRequiredBandwidth(const Piano *piano, const Key &key, int keyIndex);
+
+    KernelCache &getKernelCache() { return mKernelCache; }    ///< Cache for the tuning kernels
+
+    static const int TUNING_SEARCH_SIZE = 200;  ///< Search range of the tuning deviation in cents
+    static const int INHARMONICITY_WINDOW = 80; ///< Window around each partial in cents
+    static const double INHARMONICITY_SCAN_STEP; ///< Factor between coarse candidates of B
+    static const double INHARMONICITY_TOLERANCE; ///< Final relative accuracy of B
+    static const double MINIMAL_PEAK_AMPLITUDE; ///< Amplitude of a detectable partial, below 16 bit PCM
+
 private:
 
     const int NumberOfBins=Key::NumberOfBins;
 
     SpectrumType mOptimalSuperposition;         ///< Superposition of the partials
     FFT_Implementation mFFT;                    ///< Instance of FFT implementation
-    SpectrumType mCurrentKernel;                ///< The current kernel for the key detection
-    const Key *mCurrentKernelKey;               ///< The key of which mCurrentKernel belongs to
+    KernelCache mKernelCache;                   ///< Fourier transforms of the kernels of all keys
+    FFTComplexVector mCorrelationFFT;           ///< Buffer for the correlation in Fourier space
+    SpectrumType mCorrelation;                  ///< Buffer for the circular correlation
+    SpectrumType mSquaredSpectrum;              ///< Squared spectrum for the inharmonicity scan
+    SpectrumType mSuperposition;                ///< Buffer for the inharmonicity scan
+    SpectrumType mBand;                         ///< Buffer for the band around the magnified peak
+    ObjectPool<SpectrumType> mSpectrumPool;     ///< Recycled storage of the cached log spectra
 
 
 private:    
-    void   constructLogBinnedSpectrum(FFTDataPointer fftData, SpectrumType &spectrum);
-    SpectrumType constructKernel(const SpectrumType &originalSpectrum);
-    TuningDeviationCurveType computeTuningDeviation(const SpectrumType &kernel, const SpectrumType &signal, int searchSize);
+    std::shared_ptr<const SpectrumType> getLogBinnedSpectrum(FFTDataPointer fftData);
+    static CoarseGrainPlan::Pointer getLogBinningPlan (const FFTData &fftData);
+    void   constructLogBinnedBand(FFTDataPointer fftData, int firstIndex, SpectrumType &band);
+    void   computeTuningDeviation(const FFTComplexVector &kernelFFT, const SpectrumType &signal, int searchSize, TuningDeviationCurveType &out);
+    double getCenterFrequency (const Piano *piano, const Key &key);
+    double getZoomFrequency (const Piano *piano, int keyIndex, double centerFrequency);
     int    locatePeak (const SpectrumType &spectrum, int m, int width);
     double interpolatePeakPosition (const SpectrumType &spectrum, int m, int width);
     int    findNearestKey (double f, double conertPitch, int numberOfKeys, int keyNumberOfA);
@@ -80,12 +108,13 @@ private:
     double findAccuratePeakFrequency (FFTDataPointer fftData, double f, int cents=5);
 
     double getExpectedInharmonicity (double f);
-    double estimateInharmonicity (FFTDataPointer fftData, SpectrumType &spectrum, double f);
+    double estimateInharmonicity (FFTDataPointer fftData, const SpectrumType &spectrum, double f);
+    double computeSuperpositionEntropy (double f, int N, double B, SpectrumType &superposition);
     double estimateQuality ();
     double estimateFrequencyShift();
     PeakListType identifyPeaks (FFTDataPointer fftData, const SpectrumType &spectrum, const double f, const double B);
 
-    void Write(std::string filename, SpectrumType &v); // only for development
+    void Write(std::string filename, const SpectrumType &v); // only for development
     void Write(std::string filename, FFTComplexVector &v);
     void WritePeaks(std::string filename, SpectrumType &v, PeakListType &peaks); // only for development
 };
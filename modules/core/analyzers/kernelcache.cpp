@@ -0,0 +1,237 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                    Cache for the tuning deviation kernels
+//=============================================================================
+
+#include "kernelcache.h"
+
+#include <cstring>
+
+#include "../system/log.h"
+#include "../system/eptexception.h"
+
+//-----------------------------------------------------------------------------
+//                              Constructor
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Constructor, creating an empty cache.
+///////////////////////////////////////////////////////////////////////////////
+
+KernelCache::KernelCache() :
+    PersistentThreadHandler("KernelCache"),
+    mMutex(),
+    mEntries(),
+    mPending()
+{}
+
+
+//-----------------------------------------------------------------------------
+//                    Precompute the kernels of all keys
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Precompute the kernels of all recorded keys of a piano.
+///
+/// This function is called when a project is loaded. The spectra of the
+/// recorded keys are copied and processed in the background thread.
+/// Kernels of keys which are not recorded are removed. Kernels whose
+/// spectrum did not change are kept.
+/// \param piano : Piano holding the recorded keys
+///////////////////////////////////////////////////////////////////////////////
+
+void KernelCache::precompute (const Piano &piano)
+{
+    std::map<int, SpectrumType> pending;
+    const int numberOfKeys = piano.getKeyboard().getNumberOfKeys();
+    for (int keyIndex = 0; keyIndex < numberOfKeys; ++keyIndex)
+    {
+        const Key &key = piano.getKey(keyIndex);
+        if (key.isRecorded() and key.getSpectrum().size() == static_cast<size_t>(Key::NumberOfBins))
+            pending[keyIndex] = key.getSpectrum();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto it = mEntries.begin(); it != mEntries.end(); )
+        {
+            if (pending.count(it->first) == 0) it = mEntries.erase(it);
+            else ++it;
+        }
+        mPending = std::move(pending);
+        LogI("Precomputing %d tuning kernels", static_cast<int>(mPending.size()));
+    }
+    post(true);
+}
+
+
+//-----------------------------------------------------------------------------
+//                      Update the kernel of a single key
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Update the kernel of a single key after its spectrum changed.
+///
+/// If the cached kernel belongs to the same spectrum nothing happens.
+/// Otherwise the kernel is recomputed in the background thread.
+/// \param keyIndex : Index of the key
+/// \param key : The key holding the (possibly new) spectrum
+///////////////////////////////////////////////////////////////////////////////
+
+void KernelCache::update (int keyIndex, const Key &key)
+{
+    const SpectrumType &spectrum = key.getSpectrum();
+    if (not key.isRecorded() or spectrum.size() != static_cast<size_t>(Key::NumberOfBins)) return;
+
+    const uint64_t hash = computeHash(spectrum);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mEntries.find(keyIndex);
+        if (it != mEntries.end() and it->second.hash == hash) return;
+        mPending[keyIndex] = spectrum;
+    }
+    post(true);
+}
+
+
+//-----------------------------------------------------------------------------
+//                      Get the kernel of a given key
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the Fourier transform of the kernel belonging to a spectrum.
+///
+/// If the kernel of the key is cached and was computed from the same
+/// spectrum, it is returned immediately. Otherwise it is computed in the
+/// calling thread and stored in the cache. This function must not be
+/// called from different threads at the same time.
+/// \param keyIndex : Index of the key
+/// \param spectrum : Logarithmically binned spectrum of the key
+/// \return Shared pointer to the Fourier transform of the kernel
+///////////////////////////////////////////////////////////////////////////////
+
+KernelCache::KernelPointer KernelCache::getKernelFFT (int keyIndex, const SpectrumType &spectrum)
+{
+    const uint64_t hash = computeHash(spectrum);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mEntries.find(keyIndex);
+        if (it != mEntries.end() and it->second.hash == hash) return it->second.kernelFFT;
+    }
+
+    KernelPointer kernelFFT = computeKernelFFT(spectrum, mFFT);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries[keyIndex] = {hash, kernelFFT};
+    return kernelFFT;
+}
+
+
+//-----------------------------------------------------------------------------
+//                          Hash of a spectrum
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute a 64-bit FNV-1a hash over the bits of a spectrum.
+/// \param spectrum : The spectrum
+/// \return Hash value
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t KernelCache::computeHash (const SpectrumType &spectrum)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (double value : spectrum)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ULL;
+    }
+    return hash ^ spectrum.size();
+}
+
+
+//-----------------------------------------------------------------------------
+//                  Background computation of the kernels
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the kernels of all pending spectra in the background.
+///////////////////////////////////////////////////////////////////////////////
+
+void KernelCache::processJob (bool &)
+{
+    while (not cancelThread())
+    {
+        int keyIndex;
+        SpectrumType spectrum;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mPending.empty()) return;
+            keyIndex = mPending.begin()->first;
+            spectrum = std::move(mPending.begin()->second);
+            mPending.erase(mPending.begin());
+        }
+
+        const uint64_t hash = computeHash(spectrum);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mEntries.find(keyIndex);
+            if (it != mEntries.end() and it->second.hash == hash) continue;
+        }
+
+        KernelPointer kernelFFT = computeKernelFFT(spectrum, mWorkerFFT);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEntries[keyIndex] = {hash, kernelFFT};
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+//                   Compute the kernel of a single key
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the Fourier transform of the kernel of a spectrum.
+///
+/// The kernel is the inverse of the spectrum in Fourier space, i.e., its
+/// transform is given by c/|c|^2 where c is the transform of the spectrum.
+/// Since only the transform of the kernel is needed for the correlation,
+/// the backward and forward transforms of the kernel itself are skipped.
+/// They would only multiply the result by N and remove the imaginary
+/// parts of the first and the last component, which is done directly.
+/// \param spectrum : Logarithmically binned spectrum of size N
+/// \param fft : FFT implementation to be used
+/// \return Fourier transform of the kernel (size N/2+1)
+///////////////////////////////////////////////////////////////////////////////
+
+KernelCache::KernelPointer KernelCache::computeKernelFFT (const SpectrumType &spectrum, FFTAdapter &fft)
+{
+    EptAssert(spectrum.size() >= 2 and spectrum.size() % 2 == 0, "Spectrum size has to be even");
+    auto kernelFFT = std::make_shared<FFTComplexVector>();
+    fft.calculateFFT(spectrum, *kernelFFT);
+    const double N = static_cast<double>(spectrum.size());
+    for (FFTComplexType &c : *kernelFFT)
+    {
+        c = N * c / (c.real() * c.real() + c.imag() * c.imag());
+    }
+    kernelFFT->front().imag(0);
+    kernelFFT->back().imag(0);
+    return kernelFFT;
+}
@@ -0,0 +1,88 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                    Cache for the tuning deviation kernels
+//=============================================================================
+
+#ifndef KERNELCACHE_H
+#define KERNELCACHE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#include "prerequisites.h"
+#include "../piano/piano.h"
+#include "../math/fftimplementation.h"
+#include "../system/persistentthreadhandler.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Content-addressed cache for the kernels of the tuning deviation
+///
+/// In the tuning mode the FFTAnalyzer correlates the current spectrum with
+/// a kernel which is derived from the recorded spectrum of the selected key
+/// (see FFTAnalyzer::computeTuningDeviation). The cache holds the Fourier
+/// transform of this kernel for each key. An entry is identified by the
+/// key index and a hash of the spectrum it was computed from. Hence an
+/// entry becomes invalid automatically as soon as the spectrum of the key
+/// changes, no matter which copy of the key is passed.
+///
+/// When a project is loaded, the kernels of all recorded keys are
+/// precomputed in a background thread, so that no kernel has to be
+/// constructed while the user is tuning. Newly recorded keys are updated
+/// in the background as well.
+///////////////////////////////////////////////////////////////////////////////
+
+class EPT_EXTERN KernelCache : public PersistentThreadHandler<bool>
+{
+public:
+    using SpectrumType = Key::SpectrumType;                     ///< Type of a log spectrum
+    using KernelPointer = std::shared_ptr<const FFTComplexVector>; ///< Shared kernel transform
+
+    KernelCache();                                              ///< Constructor
+    ~KernelCache() { shutdown(); }                              ///< Destructor terminating the thread
+
+    void precompute (const Piano &piano);                       // Precompute all recorded keys
+    void update (int keyIndex, const Key &key);                 // Update a single key
+
+    KernelPointer getKernelFFT (int keyIndex, const SpectrumType &spectrum);
+
+    static uint64_t computeHash (const SpectrumType &spectrum); // Hash of a spectrum
+
+private:
+    /// Cached kernel of a single key
+    struct Entry
+    {
+        uint64_t hash;                                          ///< Hash of the spectrum
+        KernelPointer kernelFFT;                                ///< Fourier transform of the kernel
+    };
+
+    void processJob (bool &) override final;                    // Background computation
+    static KernelPointer computeKernelFFT (const SpectrumType &spectrum, FFTAdapter &fft);
+
+    std::mutex mMutex;                                          ///< Mutex protecting the maps
+    std::map<int, Entry> mEntries;                              ///< Cached kernels by key index
+    std::map<int, SpectrumType> mPending;                       ///< Spectra waiting for the background thread
+    FFT_Implementation mFFT;                                    ///< FFT used by the calling thread
+    FFT_Implementation mWorkerFFT;                              ///< FFT used by the background thread
+};
+
+#endif // KERNELCACHE_H
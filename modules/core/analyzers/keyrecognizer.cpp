@@ -30,14 +30,17 @@
 
 #include "../config.h"
 #include "../math/mathtools.h"
+#include "../math/coarsegrainplan.h"
 #include "../piano/piano.h"
 #include "../system/log.h"
 
 const int    KeyRecognizer::M = 1024;
 const double KeyRecognizer::fmin = 20;
 const double KeyRecognizer::fmax = 10000;
+const int    KeyRecognizer::NUMBER_OF_REGISTERS = 16;
 const double KeyRecognizer::logfmin = log(fmin);
 const double KeyRecognizer::logfmax = log(fmax);
+const double KeyRecognizer::binsPerLog = M / (logfmax - logfmin);
 
 
 //-----------------------------------------------------------------------------
@@ -50,6 +53,7 @@ const double KeyRecognizer::logfmax = log(fmax);
 ///////////////////////////////////////////////////////////////////////////////
 
 KeyRecognizer::KeyRecognizer(KeyRecognizerCallback *callback) :
+    PersistentThreadHandler("KeyRecognizer"),
     mCallback(callback),                // Pointer to the caller
     mFFTPtr(nullptr),                   // Pointer to the Fourier transform
     mConcertPitch(0),                   // Concert pitch in Hz (normally 440)
@@ -58,13 +62,19 @@ KeyRecognizer::KeyRecognizer(KeyRecognizerCallback *callback) :
     mKeyNumberOfA(0),                   // Index of the A-key (normally 48)
     mFFT(),                             // Instance of FFT implementation
     mLogSpec(M),                        // Vector holding the log. spectrum
+    mDecibel(M),                        // Vector holding the log. spectrum in dB
     mFlatSpectrum(M),                   // Vector holding the loglog. spectrum
-    mKernelFFT(M/2+1),                  // Vector holding the complex FFT of the kernel
     mFlatFFT(M/2+1),                    // Vector holding the complex FFT of the loglogspec
+    mProduct(M/2+1),                    // Vector holding the product of the complex FFTs
+    mRegisterConvolution(M),            // Convolution vector of a single register, real
     mConvolution(M),                    // Convolution vector, real
     mSelectedKey(-1),                   // Selected key
-    mKeyForced(false)                   // selected key is forced
-{}
+    mKeyForced(false),                  // selected key is forced
+    mConfidence(0),                     // confidence of the recognition
+    mBinFrequencies(M)                  // Table of the bin frequencies
+{
+    for (int m=0; m<M; ++m) mBinFrequencies[m] = fmin * pow(fmax/fmin,static_cast<double>(m)/M);
+}
 
 
 //-----------------------------------------------------------------------------
@@ -74,15 +84,15 @@ KeyRecognizer::KeyRecognizer(KeyRecognizerCallback *callback) :
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Initialization of the KeyRecognizer.
 ///
-/// This function defines the kernel and optimizes the plan for the FFT.
-/// Optimization will take a while to be finished.
+/// This function optimizes the plan for the FFT. Optimization will take
+/// a while to be finished. The kernels are defined with the first job,
+/// since they depend on the piano.
 /// \param optimize : true if the FFT should be optimized
 ///////////////////////////////////////////////////////////////////////////////
 
 void KeyRecognizer::init(bool optimize)
 {
     LogV("KeyRecognizer: starting initialization");
-    defineKernel();
     if (optimize)
     {
         mFFT.optimize(mLogSpec);
@@ -99,9 +109,11 @@ void KeyRecognizer::init(bool optimize)
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Start key recognition.
 ///
-/// Function to start the key recognition thread. This function
-/// is called by the SignalAnalyzer.
-/// \param forceRestart : true if restart of the thread is forced
+/// Function to start the key recognition in the worker thread. This function
+/// is called by the SignalAnalyzer. If the worker is still busy with the
+/// previous recognition the new data is processed afterwards, replacing
+/// data which is still waiting.
+/// \param forceRestart : true if the running recognition is cancelled
 /// \param piano : pointer to the piano data
 /// \param fftPointer : pointer to the actual FFT
 /// \param selectedKey : Number of the selected key (-1 if none)
@@ -119,19 +131,14 @@ void KeyRecognizer::recognizeKey (
     EptAssert(fftPointer, "The fft data has to exist.");
     EptAssert(fftPointer->isValid(), "Invaild fft data");
 
-    if (forceRestart) stop();                   // if restart forced stop thread
-    else if (isThreadRunning()) return;        // if it is running do nothing
+    if (forceRestart) cancel();                 // if restart forced cancel running job
 
-    // copy data from the piano
-    mPiano = piano;
-    mConcertPitch = piano->getConcertPitch();
-    mNumberOfKeys = piano->getKeyboard().getNumberOfKeys();
-    mKeyNumberOfA = piano->getKeyboard().getKeyNumberOfA4();
-    mFFTPtr = fftPointer;           // save pointer to the Fourier transform
-    mSelectedKey = selectedKey;     // copy selected key
-    mKeyForced = keyForced;         // copy forcing flag
-
-    start();                        // start the thread
+    KeyRecognizerJob job;
+    job.piano = piano;
+    job.fftPointer = fftPointer;
+    job.selectedKey = selectedKey;
+    job.keyForced = keyForced;
+    post(std::move(job));                       // process in the worker thread
 }
 
 
@@ -140,23 +147,36 @@ void KeyRecognizer::recognizeKey (
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Main worker function for executing the key recognition thread.
+/// \brief Main function executing a single key recognition in the worker
+/// thread.
+/// \param job : Data of the recognition job
 ///////////////////////////////////////////////////////////////////////////////
 
-void KeyRecognizer::workerFunction()
+void KeyRecognizer::processJob(KeyRecognizerJob &job)
 {
-    setThreadName("KeyRecognizer");
+    // copy data from the piano
+    mPiano = job.piano;
+    mConcertPitch = mPiano->getConcertPitch();
+    mNumberOfKeys = mPiano->getKeyboard().getNumberOfKeys();
+    mKeyNumberOfA = mPiano->getKeyboard().getKeyNumberOfA4();
+    mFFTPtr = job.fftPointer;       // save pointer to the Fourier transform
+    mSelectedKey = job.selectedKey; // copy selected key
+    mKeyForced = job.keyForced;     // copy forcing flag
+
     EptAssert(mFFTPtr, "FFT Data have to non zero");
     EptAssert(mFFTPtr->isValid(), "FFT Data have to exist");
     EptAssert(mCallback, "Callback class has to exist");
 
     double f=0;
+    mConfidence=0;
     if (mKeyForced and mSelectedKey>=0) f = detectForcedFrequency();
     else f = detectFrequencyInTreble();
     CHECK_CANCEL_THREAD;
 
     if (f==0)
     {
+        if (mKernelBank.empty()) defineKernelBank();    // Define kernels once
+
         constructLogSpec();             // Compute log spectrum
         CHECK_CANCEL_THREAD;
 
@@ -168,8 +188,9 @@ void KeyRecognizer::workerFunction()
     }
 
     int keynumber = findNearestKey(f);      // determine keynumber
+    if (keynumber<0) mConfidence=0;
 
-    mCallback->keyRecognized(keynumber, f); // notify callback
+    mCallback->keyRecognized(keynumber, f, mConfidence); // notify callback
 }
 
 
@@ -182,6 +203,7 @@ void KeyRecognizer::workerFunction()
 ///
 /// If a key is forced we search for the maximum of the FFT in the vicinity
 /// of the forced key with a width of a bit less than a half tone.
+/// Since the key is known, the recognition is fully confident.
 /// \return Frequency in Hz
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -202,6 +224,7 @@ double KeyRecognizer::detectForcedFrequency()
         max=fft[q];
         f=qtof(q);
     }
+    mConfidence=1;
     return f;
 }
 
@@ -242,11 +265,15 @@ double KeyRecognizer::detectFrequencyInTreble()
     if (m2/m1/n > threshold)
     {
         double max=0;
+        int qmax=q2;
         for (int q=q2; q<q3; ++q) if (fft[q]>max)
         {
             max=fft[q];
             f=qtof(q);
+            qmax=q;
         }
+        // competing peaks have to be at least a semitone apart
+        mConfidence = computeConfidence(fft, q2, q3, qmax, static_cast<int>(0.06*qmax));
     }
     return f;
 }
@@ -269,7 +296,7 @@ double KeyRecognizer::detectFrequencyInTreble()
 ////////////////////////////////////////////////////////////////////////
 
 int KeyRecognizer::ftom (double f) {
-    return static_cast<int>(0.5+M*(log(f)-logfmin)/(logfmax-logfmin));
+    return static_cast<int>(0.5+binsPerLog*(log(f)-logfmin));
 }
 
 //-----------------------------------------------------------------------------
@@ -282,11 +309,13 @@ int KeyRecognizer::ftom (double f) {
 /// This function maps the logarithmic binning index back to the
 /// frequency. It is the inverse function of ftom:
 /// \f[ f(m) = f_{min} + (f_{max}-f_{min})^{m/M} \,. \f]
+/// The frequencies of the bins are tabulated in the constructor.
 /// \param m : the index
 /// \return frequency in Hz
 ////////////////////////////////////////////////////////////////////////
 
 double KeyRecognizer::mtof (int m) {
+    if (m>=0 and m<M) return mBinFrequencies[m];
     return fmin * pow(fmax/fmin,static_cast<double>(m)/M);
 }
 
@@ -302,14 +331,27 @@ double KeyRecognizer::mtof (int m) {
 /// to a logarithmically binned spectrum. To this end the amplitudes
 /// of the FFT power spectrum are evently distributed into
 /// bins of the logarithmic spectrum (mLogSpec).
+///
+/// The spectrum is cached in the FFTData, so that it is computed only
+/// once if the same Fourier transform is analyzed repeatedly.
 ////////////////////////////////////////////////////////////////////////
 
 void KeyRecognizer::constructLogSpec()
 {
-    const int Q = static_cast<int>(mFFTPtr->fft.size());
-    std::function<double(double)> mtoq = [this,Q] (double m)
-        { return 2*fmin*Q/mFFTPtr->samplingRate*pow(fmax/fmin,m/M); };
-    MathTools::coarseGrainSpectrum (mFFTPtr->fft,mLogSpec,mtoq);
+    const FFTDataPointer fftData = mFFTPtr;
+    auto logSpec = fftData->products.get<std::vector<double>>("KeyRecognizer::LogSpec",
+        [fftData] (std::vector<double> &spectrum)
+    {
+        const size_t Q = fftData->fft.size();
+        const int samplingRate = fftData->samplingRate;
+        auto plan = CoarseGrainPlan::get("KeyRecognizer::LogSpec", Q, samplingRate, 0, [Q,samplingRate] ()
+        {
+            return CoarseGrainPlan::computeBoundaries(M, [Q,samplingRate] (double m)
+                { return 2*fmin*Q/samplingRate*pow(fmax/fmin,m/M); });
+        });
+        plan->apply(fftData->fft, spectrum);
+    }, mLogSpecPool);
+    mLogSpec = *logSpec;
 }
 
 
@@ -330,6 +372,11 @@ void KeyRecognizer::constructLogSpec()
 /// background which varies only smoothly with the frequency. The second part
 /// of the function substracts a gliding average over a certain window,
 /// centereing the loglog spectrum around the zero line.
+///
+/// Both parts are carried out in a single pass. The sum of squares in the
+/// window is updated incrementally, so that the cost is linear in M.
+/// Vanishing bins (e.g. above the Nyquist frequency) are mapped to -300dB,
+/// keeping the gliding average finite.
 ///////////////////////////////////////////////////////////////////////////////
 
 void KeyRecognizer::signalPreprocessing()
@@ -337,22 +384,23 @@ void KeyRecognizer::signalPreprocessing()
     Write("01-logspec.dat",mLogSpec);
     double norm = MathTools::computeNorm(mLogSpec);
     if (norm<=0) return;
-    auto decibel = [norm](double x) {return 10*log10(x/norm);};
-    auto dB= MathTools::transformVector<double>(mLogSpec,decibel);
-    Write("02-dB.dat",dB);
-
+    const double minimum = 1E-30 * norm;    // lower bound, -300dB
+    const double offset = 10*log10(norm);   // decibel of the norm
 
-    // Flatten noise by subtracting a gliding average
+    // Convert to decibel and flatten noise by subtracting a gliding
+    // average over the window [i-w,i]
+    const int w=30;                         // width of the average
+    double sum=0;
     for (int i=0; i<M; ++i)
     {
-        //const int w=MathTools::roundToInteger(1+5000/mtof(i)); // width of the average
-        const int w=30;
-        int a = std::max(0,i-w);
-        int b = std::min(M,i+1);
-        double sum=0;
-        for (int k=a; k<b; ++k) sum+=dB[k]*dB[k];
-        mFlatSpectrum[i]=std::max(0.0,dB[i]+sqrt(sum/(b-a))-5);
+        const double dB = 10*log10(std::max(mLogSpec[i],minimum)) - offset;
+        mDecibel[i] = dB;
+        sum += dB*dB;
+        if (i>w) sum -= mDecibel[i-w-1]*mDecibel[i-w-1];
+        const int n = std::min(i,w) + 1;    // number of bins in the window
+        mFlatSpectrum[i]=std::max(0.0,dB+sqrt(std::max(0.0,sum)/n)-5);
     }
+    Write("02-dB.dat",mDecibel);
     Write("03-dBflat.dat",mFlatSpectrum);
 
 
@@ -373,34 +421,72 @@ void KeyRecognizer::signalPreprocessing()
 }
 
 
+//-----------------------------------------------------------------------------
+//			             Define the kernel bank
+//-----------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////////////////
+/// \brief Define the bank of kernels for all registers.
+///
+/// The range of the logarithmic spectrum is divided into registers of
+/// equal width. Each register has its own kernel, defined with the
+/// expected inharmonicity at the center of the register. The kernels are
+/// stored in Fourier space, ready for the convolution.
+////////////////////////////////////////////////////////////////////////
+
+void KeyRecognizer::defineKernelBank ()
+{
+    EptAssert(mPiano, "The piano has to be set.");
+    mKernelBank.resize(NUMBER_OF_REGISTERS);
+    for (int r=0; r<NUMBER_OF_REGISTERS; ++r)
+    {
+        Kernel &kernel = mKernelBank[r];
+        kernel.begin = r*M/NUMBER_OF_REGISTERS;
+        kernel.end = (r+1)*M/NUMBER_OF_REGISTERS;
+        kernel.B = mPiano->getExpectedInharmonicity(mtof((kernel.begin+kernel.end)/2));
+        defineKernel(kernel);
+    }
+}
+
+
 //-----------------------------------------------------------------------------
 //			                Define the kernel
 //-----------------------------------------------------------------------------
 
 ////////////////////////////////////////////////////////////////////////
-/// \brief Define the kernel vector for key recognition.
+/// \brief Define the kernel vector of a register for key recognition.
 ///
 /// The tuner needs to recognize the key that is pressed. The essential
 /// part in the recognition procedure is a kernel function which is
 /// convolved linearly with the actually measured spectrum. It has
 /// positive peaks in those positions where partials are expected and
-/// negative peaks in the place of wrong partials. It is stored in a
-/// in a STL map.
+/// negative peaks in the place of wrong partials.
+///
+/// The partials are placed according to the inharmonicity of the register.
+/// Partials which lie beyond the end of the spectrum for all keys of the
+/// register are omitted, since they would wrap around in the cyclic
+/// convolution. The kernel is then rescaled to the total weight of all
+/// partials, so that the responses of different registers are comparable.
+/// \param kernel : Kernel whose register and inharmonicity are defined.
+/// On return it holds the Fourier transform of the kernel.
 ////////////////////////////////////////////////////////////////////////
 
-void KeyRecognizer::defineKernel ()
+void KeyRecognizer::defineKernel (Kernel &kernel)
 {
+    const int width=M/300;          // width of the peaks in bins
+    const int partials=20;          // number of partials to be detected (20)
+    const double B=kernel.B;        // inharmonicity of the register
+    const int range=M-kernel.begin; // offsets of partials within the spectrum
 
-    static const int width=M/300;     // width of the peaks in bins
-    static const int partials=20;  // number of partials to be detected (20)
-    static const double B=0.000;   // here still with a constant inharmonicity
+    mKernel.assign(M,0);
 
-    static std::vector<double> kernel(M); //must be static for using fftw3
-    kernel.assign(M,0);
-
-    // lambda function for setting a peak
-    auto setpeak = [] (int m, double amplitude)
-    { for (int n=m-width; n<=m+width; n++) kernel[(n+M)%M]=amplitude*(width-std::abs(n-m)); };
+    // lambda function for setting a peak, returns false if out of range
+    auto setpeak = [this,width,range] (int m, double amplitude)
+    {
+        if (m>=range) return false;
+        for (int n=m-width; n<=m+width; n++) mKernel[(n+M)%M]=amplitude*(width-std::abs(n-m));
+        return true;
+    };
 
     // lambda function for computing the frequency ratio of the nth partial
     auto partial = [] (int n, double B)
@@ -417,12 +503,17 @@ void KeyRecognizer::defineKernel ()
     for (int div=2; div<=4; div++) for (int n=1; n<=30; ++n) if (n%div>0) if (n>div-2)
             setpeak(partialindex(n,B,div),-0.3*intensity(n));
 
-    for (int n=1; n<=partials; ++n) setpeak(partialindex(n, B, 1),intensity(n));
-
+    double total=0, weight=0;
+    for (int n=1; n<=partials; ++n)
+    {
+        total += intensity(n);
+        if (setpeak(partialindex(n,B,1),intensity(n))) weight += intensity(n);
+    }
+    for (auto &k : mKernel) k *= total/weight;
 
-    mFFT.calculateFFT(kernel,mKernelFFT); // calculate FFT
+    mFFT.calculateFFT(mKernel,kernel.fft); // calculate FFT
 
-    Write("05-keyrecog-kernel.dat",kernel,true);
+    Write("05-keyrecog-kernel.dat",mKernel,true);
 }
 
 
@@ -435,26 +526,69 @@ void KeyRecognizer::defineKernel ()
 ///
 /// This function estimates the frequency of a pressed piano key.
 /// To this end the logarithmically binned log spectrum is convolved with
-/// the recognition kernel for all frequencies. For speedup this
-/// convolution product is carried out by two Fourier transformations
+/// the recognition kernels for all frequencies. For speedup this
+/// convolution product is carried out by Fourier transformations
 /// (in log space instead of real space) with an ordinary multiplication
-/// in between. The m-value (slot) where the response of the kernel is
-/// maximal is then used as a first estimate of the frequency.
+/// in between. The spectrum is transformed only once, followed by a
+/// multiplication and an inverse transformation for each register.
+/// The convolution of each register is kept in the range of the register.
+/// The m-value (slot) where the response of the kernels is maximal is
+/// then used as a first estimate of the frequency. The confidence is
+/// given by the ratio of the maximum and the highest response more than
+/// a semitone away.
 /// \return Estimated frequency in Hz
 ///////////////////////////////////////////////////////////////////////////////
 
 double KeyRecognizer::estimateFrequency ()
 {
     mFFT.calculateFFT(mFlatSpectrum,mFlatFFT);
-    for (size_t n = 0; n < mFlatFFT.size(); ++n)
-        mFlatFFT[n] *= std::conj(mKernelFFT[n]);
-    mFFT.calculateFFT(mFlatFFT,mConvolution);
+    for (const Kernel &kernel : mKernelBank)
+    {
+        for (size_t n = 0; n < mFlatFFT.size(); ++n)
+            mProduct[n] = mFlatFFT[n] * std::conj(kernel.fft[n]);
+        mFFT.calculateFFT(mProduct,mRegisterConvolution);
+        std::copy(mRegisterConvolution.begin() + kernel.begin,
+                  mRegisterConvolution.begin() + kernel.end,
+                  mConvolution.begin() + kernel.begin);
+    }
     int m  = MathTools::findMaximum(mConvolution);
     Write("06-convolution.dat",mConvolution,false);
+    const int semitone = ftom(fmin*pow(2.0,1.0/12));
+    mConfidence = computeConfidence(mConvolution, 0, M, m, semitone);
     return mtof(m);
 }
 
 
+//-----------------------------------------------------------------------------
+//			          Confidence of a recognition
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the confidence of a recognized peak.
+///
+/// The confidence compares the height of the recognized peak with the
+/// highest competitor outside an exclusion range around the peak. It reads
+/// 1-second/peak, i.e., it vanishes if there is an equally high competitor
+/// and approaches 1 if the peak is unique.
+/// \param v : Vector containing the peak
+/// \param begin : First index of the searched range
+/// \param end : Index after the last one of the searched range
+/// \param peak : Index of the recognized peak
+/// \param exclusion : Half width of the range excluded around the peak
+/// \return Confidence between 0 and 1
+///////////////////////////////////////////////////////////////////////////////
+
+double KeyRecognizer::computeConfidence (const std::vector<double> &v, int begin, int end,
+                                         int peak, int exclusion)
+{
+    if (peak<begin or peak>=end or v[peak]<=0) return 0;
+    double second=0;
+    for (int k=begin; k<end; ++k)
+        if (std::abs(k-peak)>exclusion and v[k]>second) second=v[k];
+    return 1-second/v[peak];
+}
+
+
 //-----------------------------------------------------------------------------
 //	Find the nearest key to a given frequency, assuming average stretch
 //-----------------------------------------------------------------------------
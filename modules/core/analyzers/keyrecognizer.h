@@ -25,7 +25,8 @@
 #define KEYRECOGNIZER_H
 
 #include "prerequisites.h"
-#include "../system/simplethreadhandler.h"
+#include "../system/persistentthreadhandler.h"
+#include "../system/objectpool.h"
 #include "../messages/messagelistener.h"
 #include "../piano/piano.h"
 #include "../math/fftimplementation.h"
@@ -36,12 +37,14 @@
 ///
 /// When KeyRecognizer::recognizeKey has
 /// finished, the pure virtual function keyRecognized() will be called.
+/// Apart from the key and its frequency it receives a confidence value
+/// between 0 (no clear recognition) and 1 (unique recognition).
 ///////////////////////////////////////////////////////////////////////////////
 
 class EPT_EXTERN KeyRecognizerCallback
 {
 public:
-    virtual void keyRecognized(int keyIndex, double frequency) = 0;
+    virtual void keyRecognized(int keyIndex, double frequency, double confidence) = 0;
 };
 
 
@@ -50,21 +53,40 @@ public:
 /// \brief Module for fast recognition of the pressed key.
 ///
 /// When a key is pressed, the SignalAnalyzer calls the function
-/// recognizeKey to start an independent thread for key recognition on the
-/// basis of the current Fourier transform. The key recognizer transmits the
-/// estimated frequency and the corresponding key number via a callback function.
+/// recognizeKey to start the key recognition on the basis of the current
+/// Fourier transform in an independent thread. The key recognizer transmits
+/// the estimated frequency and the corresponding key number via a callback
+/// function.
+///
+/// The spectrum is correlated with a bank of kernels, one for each
+/// register, which take the expected inharmonicity of the register into
+/// account.
+///
+/// The recognition is carried out by a persistent worker thread. If a new
+/// Fourier transform arrives while the worker is busy, it replaces the
+/// one waiting to be processed, so that always the latest data is used.
 ////////////////////////////////////////////////////////////////////////////////
 
-class EPT_EXTERN KeyRecognizer : public SimpleThreadHandler
+/// Data needed for a single key recognition
+struct KeyRecognizerJob
+{
+    const Piano *piano = nullptr;                       ///< Pointer to the piano data
+    FFTDataPointer fftPointer;                          ///< Pointer to the Fourier transform
+    int selectedKey = -1;                               ///< Number of the selected key
+    bool keyForced = false;                             ///< Flag indicating that the key is forced
+};
+
+class EPT_EXTERN KeyRecognizer : public PersistentThreadHandler<KeyRecognizerJob>
 {
 private:
     static const int    M;                              ///< Number of bins (powers of 2,3,5)
     static const double fmin;                           ///< Frequency of bin 0
     static const double fmax;                           ///< Frequency of bin M-1
+    static const int    NUMBER_OF_REGISTERS;            ///< Number of kernels in the bank
 
 public:
     KeyRecognizer (KeyRecognizerCallback *callback);    // Constructor
-    ~KeyRecognizer(){}                                  // Empty destructor
+    ~KeyRecognizer() { shutdown(); }                    // Destructor terminating the thread
 
     void init(bool optimize);                           // Initialize (optimize FFT)
     void recognizeKey(bool forceRestart,                // Recognize a key:
@@ -73,15 +95,17 @@ public:
                       int selectedKey, bool keyForced);
 
 private:
-    void workerFunction() override final;               // Thread execution function
+    void processJob(KeyRecognizerJob &job) override final;  // Job executed in the thread
 
     double detectForcedFrequency();                     // Handle forced keys
     double detectFrequencyInTreble();                   // Handle keys in the treble
     void constructLogSpec();                            // Construct logarithmic spectrum
     void signalPreprocessing();                         // Preprocessing of the signal
-    void defineKernel();                                // Define convolution kernel
+    void defineKernelBank();                            // Define kernels of all registers
     double estimateFrequency();                         // Frequency recognition
     int findNearestKey (double f);                      // Find nearest key, 0 if none
+    static double computeConfidence (const std::vector<double> &v, int begin, int end,
+                                     int peak, int exclusion);  // Peak-to-second-peak measure
 
 private:
     KeyRecognizerCallback *mCallback;                   ///< Pointer to the caller
@@ -92,16 +116,37 @@ private:
     int mKeyNumberOfA;                                  ///< Index of the A-key
     FFT_Implementation mFFT;                            ///< Instance of FFT implementation
     std::vector<double> mLogSpec;                       ///< Logarithmic spectrum (LogSpec)
+    ObjectPool<std::vector<double>> mLogSpecPool;       ///< Recycled storage of the cached LogSpec
+    std::vector<double> mDecibel;                       ///< Logarithmic spectrum in decibel
     std::vector<double> mFlatSpectrum;                  ///< DoubleLogarithmic spectrum (LogLogSpec)
-    FFTComplexVector mKernelFFT;                        ///< Fourier transform of the kernel
     FFTComplexVector mFlatFFT;                          ///< Fourier transform of LogLogSpec
-    FFTRealVector mConvolution;                         ///< Convolution vector
+    FFTComplexVector mProduct;                          ///< Product of the transforms of LogLogSpec and kernel
+    FFTRealVector mRegisterConvolution;                 ///< Convolution with the kernel of a register
+    FFTRealVector mConvolution;                         ///< Convolution vector, composed of all registers
     int mSelectedKey;                                   ///< Number of the actually selected key
     bool mKeyForced;                                    ///< Flag indicating that the key is forced
+    double mConfidence;                                 ///< Confidence of the current recognition
+
+private:
+    /// Recognition kernel for the fundamental frequencies of a register
+    struct Kernel
+    {
+        int begin = 0;                                  ///< First bin of the register
+        int end = 0;                                    ///< Bin after the last one of the register
+        double B = 0;                                   ///< Inharmonicity of the register
+        FFTComplexVector fft;                           ///< Fourier transform of the kernel
+    };
+
+    void defineKernel (Kernel &kernel);                 // Define the kernel of a register
+
+    std::vector<Kernel> mKernelBank;                    ///< Kernels of all registers
+    std::vector<double> mKernel;                        ///< Kernel in log space during definition
 
 private:
     static const double logfmin;                        ///< Log of minimal frequency
     static const double logfmax;                        ///< Log of maximal frequency
+    static const double binsPerLog;                     ///< Number of bins per unit of log(f)
+    std::vector<double> mBinFrequencies;                ///< Table of the frequencies of the bins
     double mtof (int m);                                ///< Map bin index to frequency
     int ftom (double f);                                ///< Map frequency to bin index
 
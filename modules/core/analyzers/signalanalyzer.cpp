@@ -37,7 +37,10 @@
 #include "../messages/messagetuningdeviation.h"
 #include "../messages/messagesignalanalysis.h"
 #include "../audio/recorder/audiorecorder.h"
+#include "../adapters/filemanager.h"
 #include "../math/mathtools.h"
+#include "../math/simdtools.h"
+#include "../math/coarsegrainplan.h"
 
 #include <cmath>
 #include <iostream>
@@ -45,6 +48,8 @@
 #include <algorithm>
 #include <numeric>
 
+const double SignalAnalyzer::EARLY_DECISION_CONFIDENCE = 0.5;
+
 //-----------------------------------------------------------------------------
 //                              Constructor
 //-----------------------------------------------------------------------------
@@ -59,7 +64,11 @@ SignalAnalyzer::SignalAnalyzer(AudioRecorder *recorder) :
     mDataBuffer(),
     mAudioRecorder(recorder),
     mRecording(false),
+    mSubsonicFollower(0),
     mKeyRecognizer(this),
+    mConfidentKey(-1),
+    mConfidentRecognitions(0),
+    mEarlyDecisionKey(-1),
     mSelectedKey(-1),
     mKeyForced(false),
     mAnalyzerRole(ROLE_IDLE)
@@ -74,13 +83,19 @@ SignalAnalyzer::SignalAnalyzer(AudioRecorder *recorder) :
 /// \brief Initializes the SignalAnalyzer and its components
 ///
 /// This function will initialize the KeyRecognizer that could take a while if
-/// the fft transform shall be optimized.
+/// the fft transform shall be optimized. Therefore the wisdom of the FFT
+/// planner is restored from the cache before and saved afterwards, so
+/// that the optimization is carried out only once per machine.
 ///////////////////////////////////////////////////////////////////////////////
 
 void SignalAnalyzer::init()
 {
+    LogI("Vectorized spectral kernels use the instruction set: %s", SimdTools::getInstructionSet());
 #if CONFIG_OPTIMIZE_FFT
+    const std::string wisdomFile = FileManager::getSingleton().getCacheFilePath("fftw.wisdom");
+    FFT_Implementation::importWisdom(wisdomFile);
     mKeyRecognizer.init(true);
+    FFT_Implementation::exportWisdom(wisdomFile);
 #else
     mKeyRecognizer.init(false);
 #endif
@@ -98,7 +113,10 @@ void SignalAnalyzer::init()
 
 void SignalAnalyzer::stop()
 {
-    mKeyRecognizer.stop();
+    mKeyRecognizer.cancel();
+    // wake up the thread if it is waiting for audio data
+    setCancelThread(true);
+    mAudioRecorder->interruptWait();
     SimpleThreadHandler::stop();
 }
 
@@ -122,6 +140,18 @@ void SignalAnalyzer::handleMessage(MessagePtr m)
         auto mpf(std::static_pointer_cast<MessageProjectFile>(m));
         mPiano = &mpf->getPiano();
         updateOverpull();
+        // precompute the tuning kernels of the loaded piano
+        if (mpf->getFileMessageType() == MessageProjectFile::FILE_OPENED or
+            mpf->getFileMessageType() == MessageProjectFile::FILE_CREATED)
+            mFFTAnalyser.getKernelCache().precompute(*mPiano);
+        break;
+    }
+    case Message::MSG_FINAL_KEY:
+    {
+        // update the tuning kernel if the spectrum of the key changed
+        auto mfk(std::static_pointer_cast<MessageFinalKey>(m));
+        if (mfk->getFinalKey())
+            mFFTAnalyser.getKernelCache().update(mfk->getKeyNumber(), *mfk->getFinalKey());
         break;
     }
     case Message::MSG_RECORDING_STARTED:    // start thread
@@ -129,6 +159,7 @@ void SignalAnalyzer::handleMessage(MessagePtr m)
         break;
     case Message::MSG_RECORDING_ENDED:
         mRecording = false;            // set a flag to terminate thread
+        mAudioRecorder->interruptWait();
         break;
     case Message::MSG_KEY_SELECTION_CHANGED:
     {
@@ -200,13 +231,18 @@ void SignalAnalyzer::updateDataBufferSize()
 {
     std::lock_guard<std::mutex> lock(mDataBufferMutex);
 
+    // the content is discarded, so that resizing does not copy any data
+    mDataBuffer.clear();
     switch (mAnalyzerRole.load())
     {
         case ROLE_IDLE:
             break;
         case ROLE_RECORD_KEYSTROKE:
         {
+            // The final spectrum is stored in the key, use the full bandwidth
+            mDecimator.setFactor(1);
             // Initialize the local circular buffer which holds about a minute of data
+            mDataBuffer.setMirrored(false);
             mDataBuffer.resize(mAudioRecorder->getSampleRate() *
                                AUDIO_BUFFER_SIZE_IN_SECONDS);
             break;
@@ -218,11 +254,28 @@ void SignalAnalyzer::updateDataBufferSize()
             const double timeAtHighest = 0.5;
             const double timeAtLowest = 3;
             const double time = (timeAtHighest - timeAtLowest) * globalKey / 88 + timeAtLowest;
-            mDataBuffer.resize(static_cast<size_t>(mAudioRecorder->getSampleRate() * time));
+            // Reduce the sampling rate to the bandwidth needed by the FFTAnalyzer
+            int factor = 1;
+            if (mSelectedKey >= 0 and mSelectedKey < mPiano->getKeyboard().getNumberOfKeys())
+            {
+                const double bandwidth = mFFTAnalyser.getRequiredBandwidth(
+                            mPiano, mPiano->getKey(mSelectedKey), mSelectedKey);
+                factor = Decimator::selectFactor(mAudioRecorder->getSampleRate(), bandwidth);
+            }
+            EptAssert(mAudioRecorder->getSampleRate() % factor == 0, "The reduced sampling rate has to be exact");
+            mDecimator.setFactor(factor);
+            // the buffer is read completely for each FFT, keep it contiguous.
+            // It is mirrored after resizing, since it is much shorter than in
+            // the recording mode.
+            mDataBuffer.resize(static_cast<size_t>(mAudioRecorder->getSampleRate() * time / factor));
+            mDataBuffer.setMirrored(true);
             break;
         }
     }
-    mDataBuffer.clear();
+    // preallocate the storage of the packets
+    mPacket.reserve(MAXIMAL_PACKET_SIZE);
+    mDecimator.reserve(MAXIMAL_PACKET_SIZE);
+    resetRollingStatistics();
 }
 
 
@@ -251,7 +304,7 @@ void SignalAnalyzer::workerFunction()
         MessageHandler::send<MessageSignalAnalysis>(MessageSignalAnalysis::Status::STARTED);
 
         // stop the KeyRecognizer
-        mKeyRecognizer.stop();
+        mKeyRecognizer.cancel();
 
         // post process after recording
         recordPostprocessing();
@@ -282,38 +335,74 @@ void SignalAnalyzer::recordSignal()
 
     mDataBufferMutex.lock();
     mDataBuffer.clear();
+    resetRollingStatistics();
     mDataBufferMutex.unlock();
 
     // Reset the statistics for the majority of recognized keys
-    mKeyCountStatistics.clear();
+    {
+        std::lock_guard<std::mutex> lock(mKeyCountStatisticsMutex);
+        mKeyCountStatistics.clear();
+        mConfidentKey = -1;
+        mConfidentRecognitions = 0;
+        mEarlyDecisionKey = -1;
+    }
 
     // Create a shared pointer to a vector containing the powerspectrum
     mPowerspectrum = std::make_shared<FFTData>();
     EptAssert(mPowerspectrum, "powerspectrum is accessed after while loop, be sure it is a valid pointer initially");
 
-    // Define a timer in order to send only a limited rate of FFTs.
-    Timer timer;
-
-    // define the packed to store audio data
-    AudioRecorder::PacketType packet;
-
-    // read all data from the audio recorder to clear all buffered data
-    mAudioRecorder->readAll(packet);
+    // clear all data buffered by the audio recorder
+    mAudioRecorder->clearData();
 
     // get the sampling rate
     uint samplingrate = mAudioRecorder->getSampleRate();
 
+    // In the recording mode the spectrum is accumulated incrementally
+    if (mAnalyzerRole == ROLE_RECORD_KEYSTROKE)
+    {
+        mSpectrumAccumulator.reset(samplingrate, getSegmentSize());
+        mSubsonicFollower = 0;
+    }
+
+    // Define a timer in order to send only a limited rate of FFTs.
+    // The FFTs are scheduled by deadlines, the first one is carried out
+    // as soon as enough data has arrived.
+    Timer timer;
+    Timer::TimePoint nextFFT = Timer::Clock::now();
+    const size_t minimalSize = (samplingrate * MINIMAL_FFT_INTERVAL_IN_MILLISECONDS) / 1000;
+
     // Loop that continuously reads the audio stream and performs FFTs
     while (mRecording and not cancelThread())
     {
+        // Sleep without polling: If the buffer does not yet hold enough data
+        // for an FFT, the audio recorder wakes us up as soon as the missing
+        // data has arrived. Otherwise we sleep until the next FFT is due.
+        // Stopping the thread and the end of the recording interrupt the sleep.
+        // The buffer size is measured in recorded (not decimated) samples
+        size_t bufferSize;
+        {
+            std::lock_guard<std::mutex> lock(mDataBufferMutex);
+            bufferSize = mDataBuffer.size() * mDecimator.getFactor();
+        }
         timer.reset();
-        mAudioRecorder->readAll(packet);    // Read audio data
-        if (packet.size() > 0)
+        if (bufferSize <= minimalSize)
+            mAudioRecorder->waitForData(minimalSize + 1 - bufferSize, timer.getDeadline(MAXIMAL_WAIT_IN_MILLISECONDS));
+        else if (Timer::Clock::now() < nextFFT)
+            mAudioRecorder->waitForData(AudioRecorder::NO_WAKEUP, nextFFT);
+        else
+            mAudioRecorder->waitForData(1, timer.getDeadline(MAXIMAL_WAIT_IN_MILLISECONDS));
+        if (not mRecording or cancelThread()) break;
+
+        // Access new audio data in place
+        const AudioRecorder::SpansType spans = mAudioRecorder->readData();
+        if (spans.size() > 0)
         {
             // lock the data puffer if new data available during compile comutation run
             std::lock_guard<std::mutex> lock(mDataBufferMutex);
 
-            for (auto &d : packet) mDataBuffer.push_back(d);
+            // only the new samples are preprocessed
+            appendSamples(spans.first.data, spans.first.size);
+            appendSamples(spans.second.data, spans.second.size);
 
             if (mAnalyzerRole == ROLE_RECORD_KEYSTROKE) {
                 if (mDataBuffer.size() == mDataBuffer.maximum_size()) {
@@ -321,38 +410,37 @@ void SignalAnalyzer::recordSignal()
                 }
             }
 
-            // If the buffer has accumulated a certain minimum of data
-            if (mDataBuffer.size() > (samplingrate * MINIMAL_FFT_INTERVAL_IN_MILLISECONDS) / 1000)
-            {
+            // the data is copied, hand the space back to the audio thread
+            mAudioRecorder->releaseData(spans.size());
 
-                // Get audio data and make it suitable for analysis
-                mProprocessedSignal = mDataBuffer.getOrderedData();
+            // If the buffer has accumulated a certain minimum of data and the FFT is due
+            if (mDataBuffer.size() * mDecimator.getFactor() > minimalSize and Timer::Clock::now() >= nextFFT)
+            {
+                // schedule the next FFT with a minimal time interval in between
+                timer.reset();
+                nextFFT = timer.getDeadline(MINIMAL_FFT_INTERVAL_IN_MILLISECONDS);
 
-                // check if there is data in the buffer
-                bool dataInBuffer = false;
-                for (auto &d : mProprocessedSignal) {
-                    if (d * d > 0) {
-                        // this element contains data
-                        dataInBuffer = true;
-                        break;
-                    }
-                }
-                if (!dataInBuffer) {// no data in buffer
+                // compute the spectrum, skip if only silence was recorded
+                if (not transformData()) {
                     continue;
                 }
-
-                // preprocess signal
-                signalPreprocessing(mProprocessedSignal);
                 CHECK_CANCEL_THREAD;
 
-                // process signal
-                signalProcessing(mProprocessedSignal, samplingrate);
+                powerspectrumProcessing();
 
-                // Finally let's wait until a certain minimal time has elapsed.
-                timer.waitUntil (MINIMAL_FFT_INTERVAL_IN_MILLISECONDS);
+                // finish the recording as soon as the key is identified reliably
+                if (isEarlyDecisionReached())
+                {
+                    LogI("Key identified reliably, finishing the recording early.");
+                    {
+                        std::lock_guard<std::mutex> lock(mKeyCountStatisticsMutex);
+                        mEarlyDecisionKey = mConfidentKey;
+                    }
+                    mAudioRecorder->finishRecording();
+                    break;
+                }
             }
         }
-        timer.wait(50);
     }
     LogI("Recording complete, total FFT size = %d.",static_cast<int>(mPowerspectrum->fft.size()));
 }
@@ -376,7 +464,7 @@ void SignalAnalyzer::analyzeSignal()
 
     // check the audio signal for possible
     // clipping effects and unusually long strings of zero amplitudes
-    detectClipping(mDataBuffer.getOrderedData());
+    detectClipping(mDataBuffer.spans());
 
     CHECK_CANCEL_THREAD;
 
@@ -417,18 +505,34 @@ void SignalAnalyzer::analyzeSignal()
     }
     else if (mAnalyzerRole == ROLE_ROLLING_FFT)
     {
-        std::shared_ptr<Key> key = std::make_shared<Key>(mPiano->getKey(keynumber));
-        FrequencyDetectionResult result = mFFTAnalyser.detectFrequencyOfKnownKey(mPowerspectrum, mPiano, *key, keynumber);
+        // This is done for every FFT. The key, the result and the messages
+        // are recycled, messages which have been released by all listeners
+        // give back the key and the result before.
+        mFinalKeyMessagePool.recycle([] (MessageFinalKey &message) { message.releaseData(); });
+        mDeviationMessagePool.recycle([] (MessageTuningDeviation &message) { message.releaseData(); });
+
+        std::shared_ptr<Key> key = mKeyPool.acquire();
+        *key = mPiano->getKey(keynumber);
+        FrequencyDetectionResult result = mResultPool.acquire();
+        mFFTAnalyser.detectFrequencyOfKnownKey(mPowerspectrum, mPiano, *key, keynumber, *result);
 
         if (result->error != FFTAnalyzerErrorTypes::ERR_NONE) // if error
-            MessageHandler::send<MessageNewFFTCalculated>(result->error);
+        {
+            std::shared_ptr<MessageNewFFTCalculated> message = mMessagePool.acquire();
+            message->setError(result->error);
+            MessageHandler::getSingleton().addMessage(message);
+        }
         else
         {
             key->setTunedFrequency(result->detectedFrequency);
-            MessageHandler::send<MessageFinalKey>(keynumber, key);
+            std::shared_ptr<MessageFinalKey> message = mFinalKeyMessagePool.acquire();
+            message->setData(keynumber, key);
+            MessageHandler::getSingleton().addMessage(message);
         }
         result->overpullInCents = key->getOverpull();
-        MessageHandler::send<MessageTuningDeviation>(result);
+        std::shared_ptr<MessageTuningDeviation> message = mDeviationMessagePool.acquire();
+        message->setData(result);
+        MessageHandler::getSingleton().addMessage(message);
     }
 }
 
@@ -440,7 +544,8 @@ void SignalAnalyzer::analyzeSignal()
 /// \brief Process the singal after recording has finsihed
 ///
 /// In the ROLE_RECORD_KEYSTROKE this will perform the actual analysis of the
-/// complete recorded signal while in the ROLE_ROLLING_FFT this wont do anything.
+/// complete recorded signal while in the ROLE_ROLLING_FFT only the overpulls
+/// are updated.
 ///////////////////////////////////////////////////////////////////////////////
 
 void SignalAnalyzer::recordPostprocessing()
@@ -449,7 +554,8 @@ void SignalAnalyzer::recordPostprocessing()
 
     if (mAnalyzerRole == ROLE_RECORD_KEYSTROKE)
     {
-        // do the actual fft analysis
+        // transform the complete keystroke and do the actual fft analysis
+        computeFinalPowerspectrum();
         analyzeSignal();
         // Debug output for signals
 #if CONFIG_ENABLE_XMGRACE
@@ -470,6 +576,104 @@ void SignalAnalyzer::recordPostprocessing()
 }
 
 
+//-----------------------------------------------------------------------------
+//                  Power spectrum of the complete keystroke
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the power spectrum of the complete keystroke.
+///
+/// During the recording the SpectrumAccumulator averages the spectra of
+/// segments of at most a few seconds. This is sufficient for the key
+/// recognition, but the frequency resolution of the final analysis is
+/// limited by the length of the transformed signal, which matters in the
+/// bass. Therefore the complete recorded signal is transformed once in
+/// double precision after the recording has ended. The result replaces
+/// mPowerspectrum and is sent as the final FFT. If the buffer contains
+/// no signal, the accumulated spectrum is kept.
+///////////////////////////////////////////////////////////////////////////////
+
+void SignalAnalyzer::computeFinalPowerspectrum()
+{
+    CHECK_CANCEL_THREAD;
+    {
+        std::lock_guard<std::mutex> lock(mDataBufferMutex);
+        mProprocessedSignal = mDataBuffer.getOrderedData();
+    }
+    signalPreprocessing(mProprocessedSignal);
+    if (mProprocessedSignal.size() < 2)
+    {
+        LogW("No signal recorded, keeping the accumulated spectrum.");
+        return;
+    }
+    CHECK_CANCEL_THREAD;
+
+    // the exact length is kept, trimming would cut the attack of the keystroke
+    if (not signalProcessing(mProprocessedSignal, mAudioRecorder->getSampleRate(), false)) return;
+    CHECK_CANCEL_THREAD;
+
+    LogI("Final FFT of the complete keystroke, size = %d.", static_cast<int>(mPowerspectrum->fft.size()));
+    sendPowerspectrum(MessageNewFFTCalculated::FFTMessageTypes::FinalFFT);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Preprocessing of the complete keystroke.
+///
+/// This function performs several steps to make the recorded signal ready
+/// for the Fourier transformation:</br>
+/// 1. Remove the dc-bias and cut subsonic waves
+/// 2. Cut the silence before the keystroke
+/// 3. Modify the input signal in such a way that the volume is constant
+/// 4. Fade in and out at the end of the buffer
+/// \param signal : real-valued vector with PCM data, modified in place
+///////////////////////////////////////////////////////////////////////////////
+
+void SignalAnalyzer::signalPreprocessing(FFTWVector &signal)
+{
+    if (signal.size() == 0) return;
+    const uint sr = mAudioRecorder->getSampleRate();
+
+    // 1. Remove dc-bias and cut subsonic waves
+    const double dcBias = std::accumulate(signal.begin(), signal.end(), 0.0) / signal.size();
+    for (auto &s : signal) s -= dcBias;
+    mSubsonicFollower = 0;
+    removeSubsonicWaves(signal, sr);
+
+    // 2. Cut silence, using the same sections and trigger as the rolling FFT
+    WindowStatistics statistics;
+    statistics.reset(sr / 40, signal.size());
+    statistics.append(signal.data(), signal.size());
+    signal.erase(signal.begin(), signal.begin() + statistics.getLeadingSilence());
+    const size_t N = signal.size();
+
+    // 3. Determine the initial energy of the keystroke and
+    //    modify the input signal in such a way that the volume is constant
+    size_t blocksize = std::min<size_t>(N, sr / 5);  // 0.2 sec
+    if (blocksize == 0) return;
+    double E0 = 0;
+    for (size_t i = 0; i < blocksize; i++) E0 += signal[i] * signal[i];
+    E0 *= 2.0 / blocksize;
+    const double gamma = 50.0 / sr;
+    double E1 = E0, E2 = E0, E3 = E0;
+    for (auto &s : signal)
+    {
+        E1 += gamma * (s * s - E1);
+        E2 += gamma * (E1 - E2);
+        E3 += gamma * (E2 - E3);
+        s /= (sqrt(fabs(E3)) + 0.001);
+    }
+
+    // 4. Fade in and out at the end of the buffer
+    blocksize = N / 50;
+    for (size_t i = 0; i < blocksize; i++)
+    {
+        signal[i]         *= static_cast<double>(i) / blocksize;
+        signal[N - i - 1] *= static_cast<double>(i) / blocksize;
+    }
+}
+
+
 //-----------------------------------------------------------------------------
 //                            Update overpulls
 //-----------------------------------------------------------------------------
@@ -510,131 +714,213 @@ void SignalAnalyzer::updateOverpull ()
 }
 
 //-----------------------------------------------------------------------------
-//			                Signal preprocessing
+//			          Incremental signal preprocessing
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Function for signal preprocessing.
+/// \brief Register and preprocess newly recorded samples.
+///
+/// In the tuning mode the samples are decimated, the dc-bias and subsonic
+/// waves are removed by the streaming high-pass filter, and the running
+/// statistics used for cutting the silence are updated. In the recording
+/// mode the raw samples are stored, while the filtered samples are passed
+/// to the SpectrumAccumulator. Each sample is thus preprocessed only once
+/// when it arrives, rather than with every FFT.
 ///
-/// This function performs several steps to make the input signal ready for the
-/// Fourier transformation:</br>
-/// 1. Cut subsonic waves
-/// 2. Modify the input signal in such a way that the volume is constant.
-/// 3. Fade in and out at the end of the buffer
-/// \param signal : real-valued vector with PCM data
-/// \return Average decay time of the envelope, serving as a rough estimate
-/// whether a very low or a very high key has been hit.
+/// The samples are processed in packets of at most MAXIMAL_PACKET_SIZE
+/// samples, for which the storage has been allocated in advance.
+/// The caller has to lock the data buffer.
+/// \param samples : Pointer to the new samples
+/// \param n : Number of new samples
 ///////////////////////////////////////////////////////////////////////////////
 
-double SignalAnalyzer::signalPreprocessing(FFTWVector &signal)
+void SignalAnalyzer::appendSamples(const FFTWType *samples, size_t n)
 {
-    if (signal.size() == 0) {
-        LogW("Empty signal. Cancelling the signal preprocessing");
-        return 0 ;
+    const uint samplingrate = mAudioRecorder->getSampleRate() / mDecimator.getFactor();
+    for (size_t position = 0; position < n; position += MAXIMAL_PACKET_SIZE)
+    {
+        const FFTWType *packet = samples + position;
+        const size_t size = std::min<size_t>(n - position, MAXIMAL_PACKET_SIZE);
+        if (mAnalyzerRole == ROLE_ROLLING_FFT)
+        {
+            mDecimator.process(packet, size, mPacket);
+            removeSubsonicWaves(mPacket, samplingrate);
+            mWindowStatistics.append(mPacket.data(), mPacket.size());
+            mDataBuffer.append(mPacket.data(), mPacket.size());
+            mWindowStatistics.restrict(mDataBuffer.contiguousData(), mDataBuffer.size());
+        }
+        else
+        {
+            mDataBuffer.append(packet, size);
+            mPacket.assign(packet, packet + size);
+            removeSubsonicWaves(mPacket, samplingrate);
+            mSpectrumAccumulator.append(mPacket);
+        }
     }
+}
 
-    const uint sr = mAudioRecorder->getSampleRate();
-    uint N=(uint)signal.size();
 
-    // 1. Remove dc-Bias and cut subsonic waves
-    // For a derivation see Mathematica file in the doc folder
-    const double dcBias = std::accumulate(signal.begin(), signal.end(), 0.0) / N;
-    //for (auto &s : signal) {s -= dcBias;}
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Restart the incremental preprocessing with an empty buffer.
+///
+/// The silence is detected in sections of 0.025 seconds at the reduced
+/// sampling rate. The statistics hold the window and one further packet.
+/// The caller has to lock the data buffer.
+///////////////////////////////////////////////////////////////////////////////
+
+void SignalAnalyzer::resetRollingStatistics()
+{
+    mSubsonicFollower = 0;
+    mWindowStatistics.reset(mAudioRecorder->getSampleRate() / mDecimator.getFactor() / 40,
+                            mDataBuffer.maximum_size() + MAXIMAL_PACKET_SIZE);
+}
 
-    const double f0 = 5;            // Frequency to be suppressed by 50%
-    const double a=10.8828*f0/sr;   // Damping factor
-    double follow=0;
-    for (auto &s : signal)
+
+//-----------------------------------------------------------------------------
+//			           Streaming subsonic filter
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Cut subsonic waves of newly recorded samples.
+///
+/// The state of the high-pass filter is carried from one packet to the
+/// next so that each sample is filtered only once. The follower tracks the
+/// slowly varying dc-bias of the signal, so that no separate bias removal
+/// is needed. For a derivation see Mathematica file in the doc folder.
+/// \param packet : Newly recorded samples, filtered in place
+/// \param samplingRate : Sampling rate of the samples
+///////////////////////////////////////////////////////////////////////////////
+
+void SignalAnalyzer::removeSubsonicWaves(FFTWVector &packet, uint samplingRate)
+{
+    const double f0 = 5;                    // Frequency to be suppressed by 50%
+    const double a = 10.8828*f0/samplingRate;   // Damping factor
+    for (auto &s : packet)
     {
-        // remove dc-bias
-        s -= dcBias;
+        mSubsonicFollower += a*(s-mSubsonicFollower);
+        s -= mSubsonicFollower;
+    }
+}
 
-        // subsonic waves
-        follow += a*(s-follow);
-        s -= follow;
+
+//-----------------------------------------------------------------------------
+//			        Segment size of the spectrum accumulator
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the segment size of the spectrum accumulator.
+///
+/// The segment size determines the frequency resolution of the spectrum.
+/// Low keys require a high resolution and thus long segments of about
+/// 6 seconds, while 1.5 seconds are sufficient in the treble. The size is
+/// rounded down to a power of two.
+/// \return Segment size in samples
+///////////////////////////////////////////////////////////////////////////////
+
+size_t SignalAnalyzer::getSegmentSize() const
+{
+    const double timeAtHighest = 1.5;
+    const double timeAtLowest = 6;
+    double time = timeAtLowest;
+    if (mPiano and mSelectedKey >= 0)
+    {
+        const int globalKey = mSelectedKey + 48 - mPiano->getKeyboard().getKeyNumberOfA4();
+        time = (timeAtHighest - timeAtLowest) * globalKey / 88 + timeAtLowest;
+        time = std::max(timeAtHighest, std::min(timeAtLowest, time));
     }
+    const double samples = mAudioRecorder->getSampleRate() * time;
+    size_t size = 2;
+    while (2 * size <= samples) size *= 2;
+    return size;
+}
 
-    // cut silence
-    mAudioRecorder->cutSilence(signal);
 
-    // signal size may be changed
-    N=(uint)signal.size();
+//-----------------------------------------------------------------------------
+//			          Power spectrum of the current data
+//-----------------------------------------------------------------------------
 
-    // 2. Determine the initial energy of the keystroke:
-    uint blocksize = std::min(N,sr/5);  // 0.2 sec
-    if (blocksize<=0) return 0;
-    double E0=0;
-    for (uint i=0; i<blocksize; i++) E0+=signal[i]*signal[i];
-    E0 *= 2.0/blocksize;
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the power spectrum of the current data.
+///
+/// In the recording mode the accumulated spectrum is taken from the
+/// SpectrumAccumulator. In the tuning mode the preprocessed buffer is
+/// transformed without its leading silence. The buffer is mirrored, so its
+/// content is contiguous. The caller has to lock the data buffer.
+/// \return True if mPowerspectrum holds a new spectrum, false if the
+/// data contains no signal.
+///////////////////////////////////////////////////////////////////////////////
 
+bool SignalAnalyzer::transformData()
+{
     if (mAnalyzerRole == ROLE_RECORD_KEYSTROKE)
     {
-        // 3. Modify the input signal in such a way that the volume is constant
-        const double gamma=50.0/sr;
-        double E1=E0,E2=E0,E3=E0;
-        for (auto &s : signal) {
-            E1 += gamma * (s*s-E1);
-            E2 += gamma * (E1-E2);
-            E3 += gamma * (E2-E3);
-            s /= (sqrt(fabs(E3))+0.001);
-        }
-
-        // 4. Fade in and out at the end of the buffer
-        blocksize = N/50;
-        for (uint i=0; i<blocksize; i++) {
-            signal[i]     *= (double)i/blocksize;
-            signal[N-i-1] *= (double)i/blocksize;
-        }
-        return N/log(E0/E3)/sr; // return the average decay time of the envelope
+        FFTDataPointer powerspectrum = acquirePowerspectrum();
+        if (not mSpectrumAccumulator.getPowerspectrum(*powerspectrum)) return false;
+        mPowerspectrum = powerspectrum;
+        return true;
     }
-    else if (mAnalyzerRole == ROLE_ROLLING_FFT)
-    {
-        // 4. Apply a hanning window
-        for (size_t n = 0; n < N; ++n) {
-//            signal[n] *= 0.5 * (1.0 - cos((MathTools::TWO_PI * n) / (N - 1)));
-        }
 
-    }
+    if (not mWindowStatistics.hasSignal()) return false;
+    const FFTWType *data = mDataBuffer.contiguousData();
+    const size_t size = mDataBuffer.size();
+    const size_t silence = mWindowStatistics.getLeadingSilence();
+    mProprocessedSignal.assign(data + silence, data + size);
 
-    return 0;
+    // process signal at the reduced sampling rate
+    return signalProcessing(mProprocessedSignal, mAudioRecorder->getSampleRate() / mDecimator.getFactor(), true);
 }
 
+
 //-----------------------------------------------------------------------------
-//			                Signal preprocessing
+//			                Signal processing
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Function for signal processing.
 ///
-/// Create an FFT vector and perform the FFT.
-///
-/// On ROLE_ROLLING_FFT this will permanentely send FinalFFT
-/// On ROLE_RECORD_KEYSTRO this will peramaentely send NewFFT
+/// Perform the FFT and store the result in mPowerspectrum. The rolling
+/// FFTs are padded or trimmed before according to the FFT size policy.
+/// \param signal : Preprocessed signal, modified by the FFT size policy
+/// \param samplingrate : Sampling rate of the signal
+/// \param applySizePolicy : Adjust the size of the signal to the FFT
+/// \return True on success
 ///////////////////////////////////////////////////////////////////////////////
 
-void SignalAnalyzer::signalProcessing(FFTWVector &signal, int samplingrate) {
+bool SignalAnalyzer::signalProcessing(FFTWVector &signal, int samplingrate, bool applySizePolicy) {
     if (signal.size() == 0) {
         LogW("Empty signal. Cancelling the signal processing");
-        return;
+        return false;
     } else if (samplingrate <= 0) {
         LogW("Invalid sampling rate. Cancelling the signal processing");
-        return;
+        return false;
     }
 
-    mPowerspectrum = std::make_shared<FFTData>();
-    mPowerspectrum->samplingRate = samplingrate;
-    PerformFFT(signal, mPowerspectrum->fft);
-    if (cancelThread()) return;
+    FFTDataPointer powerspectrum = acquirePowerspectrum();
+    powerspectrum->samplingRate = samplingrate;
+    powerspectrum->signalLength = (applySizePolicy ? applyFFTSizePolicy(signal) : -1);
+    PerformFFT(signal, powerspectrum->fft);
+    if (cancelThread()) return false;
 
-    // The FFT is too long to be plotted. Therefore, we
-    // create here a shorter polygon and transmit it by a message
-    std::shared_ptr<FFTPolygon> polygon = std::make_shared<FFTPolygon>();
-    createPolygon (mPowerspectrum->fft, *polygon.get());
+    mPowerspectrum = powerspectrum;
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+//			              Power spectrum processing
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Function for processing the current power spectrum.
+///
+/// Creates the polygon for drawing, sends the spectrum and starts the
+/// KeyRecognizer. The power spectrum is taken from mPowerspectrum which
+/// was computed by transformData().
+///////////////////////////////////////////////////////////////////////////////
 
-    MessageHandler::send<MessageNewFFTCalculated>
-            ((!mRecording) ? MessageNewFFTCalculated::FFTMessageTypes::FinalFFT :
-                       MessageNewFFTCalculated::FFTMessageTypes::NewFFT,
-             mPowerspectrum, polygon);
+void SignalAnalyzer::powerspectrumProcessing()
+{
+    sendPowerspectrum(MessageNewFFTCalculated::FFTMessageTypes::NewFFT);
 
     // recognize key
     mKeyRecognizer.recognizeKey(false, mPiano, mPowerspectrum, mSelectedKey, mKeyForced);
@@ -656,6 +942,75 @@ void SignalAnalyzer::signalProcessing(FFTWVector &signal, int samplingrate) {
     }
 }
 
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Send the current power spectrum to the GUI.
+///
+/// The FFT is too long to be plotted. Therefore, we create here a shorter
+/// polygon and transmit it by a message. The polygon is cached in the
+/// FFTData together with the other products, the message is recycled.
+/// \param type : NewFFT during the recording, FinalFFT for the spectrum
+/// of the complete keystroke
+///////////////////////////////////////////////////////////////////////////////
+
+void SignalAnalyzer::sendPowerspectrum(MessageNewFFTCalculated::FFTMessageTypes type)
+{
+    const FFTDataPointer powerspectrum = mPowerspectrum;
+    std::shared_ptr<const FFTPolygon> polygon = powerspectrum->products.get<FFTPolygon>(
+                "SignalAnalyzer::Polygon",
+                [this, &powerspectrum] (FFTPolygon &poly) { createPolygon(*powerspectrum, poly); },
+                mPolygonPool);
+
+    std::shared_ptr<MessageNewFFTCalculated> message = mMessagePool.acquire();
+    message->setData(type, mPowerspectrum, polygon);
+    MessageHandler::getSingleton().addMessage(message);
+}
+
+//-----------------------------------------------------------------------------
+//			    Pad or trim the signal to an FFT-friendly size
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Pad or trim the signal to an FFT-friendly size
+///
+/// FFTW is considerably slower if the size of the signal contains large
+/// prime factors. Depending on the FFTSizePolicy in the settings the signal
+/// is padded with zeros or its oldest samples are dropped, so that its size
+/// is an even number of the form 2^a 3^b 5^c 7^d. Zero-padding keeps the
+/// entire signal and refines the frequency grid slightly, while trimming
+/// reduces the latency at the expense of a few samples. Since the sampling
+/// rate is unchanged, all bin-to-frequency mappings remain valid.
+/// The policy applies to the rolling FFTs only, the complete keystroke is
+/// transformed with its exact length.
+/// \param signal : Signal to be modified
+/// \return Size of the signal before zero-padding, -1 if it was not padded.
+///////////////////////////////////////////////////////////////////////////////
+
+int SignalAnalyzer::applyFFTSizePolicy(FFTWVector &signal)
+{
+    const size_t N = signal.size();
+    if (N < 2) return -1;
+    switch (Settings::getSingleton().getFFTSizePolicy())
+    {
+    case FFTSizePolicy::ZERO_PAD:
+    {
+        const size_t size = 2 * MathTools::nextSmoothNumber((N + 1) / 2);
+        if (size == N) return -1;
+        signal.resize(size, 0);
+        return static_cast<int>(N);
+    }
+    case FFTSizePolicy::TRIM:
+    {
+        const size_t size = 2 * MathTools::previousSmoothNumber(N / 2);
+        signal.erase(signal.begin(), signal.begin() + (N - size));
+        return -1;
+    }
+    default:
+        return -1;
+    }
+}
+
+
 //-----------------------------------------------------------------------------
 //			            Fast Fourier transform
 //-----------------------------------------------------------------------------
@@ -665,18 +1020,43 @@ void SignalAnalyzer::signalProcessing(FFTWVector &signal, int samplingrate) {
 ///
 /// This function transforms the real-valued signal of length N to a
 /// complex-valued Fourier transform of length N/2+1. Then it computes the
-/// power spectrum by computing the intensities (squares).
+/// power spectrum by computing the intensities (squares). Both steps are
+/// carried out by a single call of the FFT implementation which writes
+/// directly into the existing power spectrum vector. The precision of the
+/// transformation depends on the current role, see getFFT().
 /// \param signal : reference to the vector of the incoming audio signal.
 /// \param powerspectrum : reference to the resulting powerspectrum.
 ///////////////////////////////////////////////////////////////////////////////
 
 void SignalAnalyzer::PerformFFT (FFTWVector &signal, FFTWVector &powerspectrum)
 {
-    FFTComplexVector cvec;
-    mFFT.calculateFFT(signal,cvec);
-    powerspectrum.clear();
-    for (auto &c : cvec)
-        powerspectrum.push_back (c.real()*c.real()+c.imag()*c.imag());
+    getFFT(mAnalyzerRole).calculatePowerSpectrum(signal, powerspectrum);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the FFT implementation used in a given role.
+///
+/// The final spectrum of a keystroke is analyzed in detail by the
+/// FFTAnalyzer and therefore computed in double precision. The rolling
+/// FFTs in the tuning mode only cover a few seconds and are evaluated
+/// on a logarithmic scale with a resolution of one cent. Here the
+/// single-precision transformation is sufficient and considerably faster.
+/// The agreement of the detected tuning deviations is checked by the test
+/// in tests/fftprecision.
+/// \param role : Role of the signal analyzer
+/// \return Reference to the FFT implementation
+///////////////////////////////////////////////////////////////////////////////
+
+FFTAdapter &SignalAnalyzer::getFFT (AnalyzerRole role)
+{
+    switch (role)
+    {
+    case ROLE_ROLLING_FFT:
+        return mFFTFloat;
+    default:
+        return mFFT;
+    }
 }
 
 
@@ -694,21 +1074,26 @@ void SignalAnalyzer::PerformFFT (FFTWVector &signal, FFTWVector &powerspectrum)
 /// Similarly, some audio devices transmit intermittent data with random
 /// strings of zeros in between. This is detected by counting the number of
 /// vanishing PCM amplitudes.
-/// \param signal : vector holding the incoming audio signal
+/// The signal is accessed in place in the buffer.
+/// \param signal : time-ordered parts of the incoming audio signal
 /// \return true if a problem has been detected, false if not
 ///////////////////////////////////////////////////////////////////////////////
 
-bool SignalAnalyzer::detectClipping(FFTWVector signal)
+bool SignalAnalyzer::detectClipping(const CircularBuffer<FFTWType>::Spans &signal)
 {
     int nullcnt=0, maxcnt=0, mincnt=0;
     double maxamp=0, minamp=0;
-    for (auto &y : signal)
+    for (const auto &span : {signal.first, signal.second})
     {
-        if (y>maxamp) maxamp=y;
-        else if (y>=maxamp*0.99) maxcnt++;
-        if (y<minamp) minamp=y;
-        else if (y<=minamp*0.99) mincnt++;
-        if (y==0) nullcnt++;
+        for (size_t i = 0; i < span.size; ++i)
+        {
+            const double y = span.data[i];
+            if (y>maxamp) maxamp=y;
+            else if (y>=maxamp*0.99) maxcnt++;
+            if (y<minamp) minamp=y;
+            else if (y<=minamp*0.99) mincnt++;
+            if (y==0) nullcnt++;
+        }
     }
     const int threshold = static_cast<int>(signal.size()) / 50;
     if (maxcnt+mincnt > threshold)
@@ -732,46 +1117,72 @@ bool SignalAnalyzer::detectClipping(FFTWVector signal)
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Create a polygon for drawing
 ///
-/// \param powerspec : reference to the power spectrum rendered by the FFT
-/// \param poly : reference to a map relating frequency and power (f->I).
+/// \param powerspectrum : power spectrum rendered by the FFT and its sampling rate
+/// \param poly : polygon relating frequency and power (f->I), overwritten.
 ///////////////////////////////////////////////////////////////////////////////
 
-void SignalAnalyzer::createPolygon (const FFTWVector &powerspec, FFTPolygon &poly) const
+void SignalAnalyzer::createPolygon (const FFTData &powerspectrum, FFTPolygon &poly) const
 {
-    const double fmin = 25;
-    const double fmax = 6000;
+    const FFTWVector &powerspec = powerspectrum.fft;
+    const int samplingrate = powerspectrum.samplingRate;
     const double cents = 10;
     const double factor = pow(2.0,cents/2400);
+    const double fmin = 25;
+    const double fmax = std::min(6000.0, samplingrate / 2 / factor);  // decimated spectra end earlier
 
     size_t fftsize = powerspec.size();
     EptAssert(fftsize>0,"powerspectum has to be non-empty");
-    int samplingrate = mAudioRecorder->getSampleRate();
     auto q = [fftsize,samplingrate] (double f) { return 2*fftsize*f/samplingrate; };
 
-    double qs1 = q(fmin/factor);
-    int q1 = std::max<int>(0, MathTools::roundToInteger(qs1));
-    double leftarea = (q1-qs1+0.5)*powerspec[q1];
-    double ymax=0, df = samplingrate / 2 / fftsize;
-    for (double f=fmin; f<=fmax; f=std::max(f*factor*factor,f+df))
-    {
-        const double qs2 = q(f*factor);
-        const int q2 = std::min<int>(MathTools::roundToInteger(qs2), static_cast<int>(powerspec.size()) - 1);
-        double sum=0;
-        for (int q=q1+1; q<=q2; ++q) sum += powerspec[q];
-        const double rightarea = (q2-qs2+0.5)*powerspec[q2];
-        const double y = sum + leftarea - rightarea;
-        if (y>ymax) ymax=y;
-        poly[f] = y;
-        q1=q2; qs1=qs2; leftarea=rightarea;
-    }
+    // Frequencies of the polygon, each point collects the power up to f*factor
+    std::vector<double> &frequencies = poly.frequencies;
+    frequencies.clear();
+    double df = samplingrate / 2 / fftsize;
+    for (double f=fmin; f<=fmax; f=std::max(f*factor*factor,f+df)) frequencies.push_back(f);
+    if (frequencies.empty()) { poly.intensities.clear(); return; }
+
+    // The bins depend only on the size and the sampling rate of the spectrum
+    auto plan = CoarseGrainPlan::get("SignalAnalyzer::Polygon", fftsize, samplingrate, 0, [&] ()
+    {
+        std::vector<double> boundaries(1, q(fmin/factor));
+        for (double f : frequencies) boundaries.push_back(q(f*factor));
+        return boundaries;
+    });
+    std::vector<double> &power = poly.intensities;
+    plan->apply(powerspec, power);
+
+    const double ymax = *std::max_element(power.begin(), power.end());
     if (ymax <= 0) {
         LogW("Power should be nonzero, possibly empty data.");
     } else {
-        for (auto &p : poly) p.second /= ymax; // normalize
+        for (auto &y : power) y /= ymax; // normalize
     }
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get a power spectrum from the pool of recycled FFTData.
+///
+/// The spectrum keeps the memory of its buffer and of its products, so
+/// that no memory has to be allocated in the steady state. Its content
+/// is reset. Spectra referenced by messages which are no longer in use
+/// are released before.
+/// \return Pointer to the power spectrum
+///////////////////////////////////////////////////////////////////////////////
+
+FFTDataPointer SignalAnalyzer::acquirePowerspectrum()
+{
+    // messages which have been released by all listeners give back their data
+    mMessagePool.recycle([] (MessageNewFFTCalculated &message) { message.releaseData(); });
+
+    FFTDataPointer powerspectrum = mPowerspectrumPool.acquire();
+    powerspectrum->products.clear();
+    powerspectrum->samplingRate = -1;
+    powerspectrum->signalLength = -1;
+    return powerspectrum;
+}
+
+
 //-----------------------------------------------------------------------------
 //                        Identify the selected key
 //-----------------------------------------------------------------------------
@@ -783,13 +1194,17 @@ void SignalAnalyzer::createPolygon (const FFTWVector &powerspec, FFTPolygon &pol
 /// of the recognized key. These results have beeen registered by the
 /// in the histogram mKeyCount. This function declares a
 /// key as selected if more it was recognized for more than 50%.
+/// If the recording was finished early, the key which was recognized
+/// reliably at that moment is selected, see isEarlyDecisionReached().
 /// \return Number of the key, -1 if none.
 ///////////////////////////////////////////////////////////////////////////////
 
 int SignalAnalyzer::identifySelectedKey()
 {
-    // Take the majority selection from KeyRecognizer
     std::lock_guard<std::mutex> lock(mKeyCountStatisticsMutex);
+    if (mEarlyDecisionKey >= 0) return mEarlyDecisionKey;
+
+    // Take the majority selection from KeyRecognizer
     if (mKeyCountStatistics.size()==0) return -1;
     auto cmp = [](const std::pair<int,int>& p1, const std::pair<int,int>& p2)
                  { return p1.second < p2.second; };
@@ -799,6 +1214,36 @@ int SignalAnalyzer::identifySelectedKey()
     return -1;
 }
 
+
+//-----------------------------------------------------------------------------
+//                        Early end of the recording
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Check whether the recording of a keystroke can be finished early.
+///
+/// Normally a keystroke is recorded until the level drops. If the selected
+/// key has been recognized reliably several times in a row and the
+/// accumulated spectrum is long enough for the final analysis, further
+/// recording would not change the result, so that the final analysis can
+/// be started immediately.
+///
+/// Since the segments overlap by 50%, EARLY_DECISION_SEGMENTS segments
+/// span two segment lengths. Apart from the silence which is cut before
+/// the keystroke, the final FFT then has about twice the frequency
+/// resolution of a single segment.
+/// \return True if the recording can be finished
+///////////////////////////////////////////////////////////////////////////////
+
+bool SignalAnalyzer::isEarlyDecisionReached()
+{
+    if (mAnalyzerRole != ROLE_RECORD_KEYSTROKE) return false;
+    if (mSpectrumAccumulator.getNumberOfSegments() < EARLY_DECISION_SEGMENTS) return false;
+    std::lock_guard<std::mutex> lock(mKeyCountStatisticsMutex);
+    return mConfidentRecognitions >= EARLY_DECISION_RECOGNITIONS and mConfidentKey == mSelectedKey;
+}
+
+
 //-----------------------------------------------------------------------------
 //                    Callback function of the KeyRecognizer
 //-----------------------------------------------------------------------------
@@ -811,12 +1256,15 @@ int SignalAnalyzer::identifySelectedKey()
 /// about recognized keys because the SignalAnalyzer keeps track of the
 /// statistics. In the end the finally recognized key is declared as the one
 /// which hat the majority of individual recognitions. This statistical
-/// information is held in mKeyCountStatistics.
+/// information is held in mKeyCountStatistics. In addition, subsequent
+/// recognitions of the same key with high confidence are counted, allowing
+/// for an early decision.
 /// \param keyIndex : Index of the key
 /// \param frequency : Recognized frequency
+/// \param confidence : Confidence of the recognition between 0 and 1
 ///////////////////////////////////////////////////////////////////////////////
 
-void SignalAnalyzer::keyRecognized(int keyIndex, double frequency)
+void SignalAnalyzer::keyRecognized(int keyIndex, double frequency, double confidence)
 {
     EptAssert(mPiano, "Piano has to be set.");
 
@@ -827,6 +1275,13 @@ void SignalAnalyzer::keyRecognized(int keyIndex, double frequency)
         {
             std::lock_guard<std::mutex> lock(mKeyCountStatisticsMutex);
             mKeyCountStatistics[keyIndex]++;
+            if (confidence < EARLY_DECISION_CONFIDENCE) mConfidentRecognitions = 0;
+            else if (keyIndex == mConfidentKey) ++mConfidentRecognitions;
+            else
+            {
+                mConfidentKey = keyIndex;
+                mConfidentRecognitions = 1;
+            }
         }
         MessageHandler::send<MessagePreliminaryKey>(identifySelectedKey(),frequency);
     }
@@ -29,13 +29,20 @@
 #include "prerequisites.h"
 
 #include "system/simplethreadhandler.h"
+#include "system/objectpool.h"
 #include "messages/messagelistener.h"
+#include "messages/messagenewfftcalculated.h"
+#include "messages/messagefinalkey.h"
+#include "messages/messagetuningdeviation.h"
 #include "audio/circularbuffer.h"
 #include "math/fftimplementation.h"
+#include "math/decimator.h"
 
 #include "fftanalyzer.h"
 #include "keyrecognizer.h"
 #include "overpull.h"
+#include "spectrumaccumulator.h"
+#include "windowstatistics.h"
 
 class AudioRecorder;
 
@@ -46,10 +53,13 @@ class AudioRecorder;
 /// It contains another cyclic buffer which can hold audio data of
 /// about a minute. After detecting a keystroke, the AudioRecorderAdapter
 /// sends a message to start the SignalAnalyzer. During recording the
-/// SignalAnalyzer continuously performs Fourer transformations on the
-/// current signal. When the recording is finished, a final Fourier
-/// transformation is carried out. Various steps for signal preprocessing
-/// are included as well.
+/// SignalAnalyzer continuously updates the power spectrum of the
+/// current signal. In the recording mode the spectrum is accumulated
+/// incrementally by the SpectrumAccumulator, in the tuning mode a rolling
+/// Fourier transformation of the most recent data is carried out. When
+/// the recording of a keystroke ends, the complete signal is transformed
+/// once, so that the final analysis has the full frequency resolution.
+/// Various steps for signal preprocessing are included as well.
 ///////////////////////////////////////////////////////////////////////////////
 
 class EPT_EXTERN SignalAnalyzer :
@@ -60,6 +70,11 @@ class EPT_EXTERN SignalAnalyzer :
 public:
     static const int AUDIO_BUFFER_SIZE_IN_SECONDS = 60;             ///< Maximal size of the audio buffer
     static const int MINIMAL_FFT_INTERVAL_IN_MILLISECONDS = 150;    ///< Time interval for at most one FFT
+    static const int MAXIMAL_WAIT_IN_MILLISECONDS = 50;             ///< Maximal time waiting for audio data (delayed wakeups)
+    static const int MAXIMAL_PACKET_SIZE = 4096;                    ///< Maximal number of samples preprocessed at once
+    static const double EARLY_DECISION_CONFIDENCE;                  ///< Confidence of a reliable recognition
+    static const int EARLY_DECISION_RECOGNITIONS = 3;               ///< Subsequent reliable recognitions required
+    static const int EARLY_DECISION_SEGMENTS = 3;                   ///< Minimal number of accumulated segments
 
 private:
 
@@ -90,18 +105,30 @@ private:
     void recordSignal();
     void analyzeSignal();
     void recordPostprocessing();                                    // processing after recording finished
+    void computeFinalPowerspectrum();                               // Full-length FFT of the keystroke
+    void signalPreprocessing(FFTWVector &signal);                   // Preprocessing of the complete keystroke
     void updateOverpull();
 
-    double signalPreprocessing(FFTWVector &signal);                 // Preprocessing of incoming signal
-    void signalProcessing(FFTWVector &signal, int samplingrate);    // processing of the current data
-    bool detectClipping(FFTWVector signal);                         // Clipping detector, not yet implemented
+    void appendSamples(const FFTWType *samples, size_t n);          // Register and preprocess new samples
+    bool transformData();                                           // Power spectrum of the current data
+    void resetRollingStatistics();                                  // Restart the incremental preprocessing
+    void removeSubsonicWaves(FFTWVector &packet, uint samplingRate);    // Streaming high-pass filter
+    bool signalProcessing(FFTWVector &signal, int samplingrate, bool applySizePolicy);  // processing of the current data
+    int applyFFTSizePolicy(FFTWVector &signal);                     // Pad or trim to an FFT-friendly size
+    void powerspectrumProcessing();                                 // processing of the current spectrum
+    void sendPowerspectrum(MessageNewFFTCalculated::FFTMessageTypes type);  // Send the current spectrum with its polygon
+    size_t getSegmentSize() const;                                  // segment size of the accumulator
+    bool detectClipping(const CircularBuffer<FFTWType>::Spans &signal); // Clipping detector
     void PerformFFT (FFTWVector &signal, FFTWVector &powerspec);    // Perform fast Fourier transformation
-    void createPolygon (const FFTWVector &powerspec, FFTPolygon &poly) const;   // Create polygon for drawing
+    FFTAdapter &getFFT (AnalyzerRole role);                         // FFT implementation used in a role
+    void createPolygon (const FFTData &powerspec, FFTPolygon &poly) const;      // Create polygon for drawing
+    FFTDataPointer acquirePowerspectrum();                          // Recycled FFTData from the pool
 
     int identifySelectedKey();              ///< identify final key
+    bool isEarlyDecisionReached();          ///< check whether the recording can be finished
 
     // callbacks
-    virtual void keyRecognized(int keyIndex, double frequency) override final;
+    virtual void keyRecognized(int keyIndex, double frequency, double confidence) override final;
 
 
 //    void WriteSignal (std::string filename, const FFTWVector &signal);    // Development, will be removed
@@ -114,20 +141,38 @@ private:
     AudioRecorder *mAudioRecorder;          ///< Pointer to the audio recorder
     std::atomic<bool> mRecording;           ///< Flag indicating ongoing recording
     FFTWVector mProprocessedSignal;         ///< the current signal (after preprocessing)
+    FFTWVector mPacket;                     ///< Newly recorded samples
     FFTDataPointer mPowerspectrum;          ///< the last recorded powerspectrum
-
-    FFT_Implementation mFFT;                ///< Instance of the Fourier transformer
+    ObjectPool<FFTData> mPowerspectrumPool; ///< Recycled power spectra
+    ObjectPool<FFTPolygon> mPolygonPool;    ///< Recycled polygons for drawing
+    ObjectPool<MessageNewFFTCalculated> mMessagePool;   ///< Recycled messages sending the spectra
+    ObjectPool<Key> mKeyPool;               ///< Recycled keys sent in the tuning mode
+    ObjectPool<FrequencyDetectionResultStruct> mResultPool;     ///< Recycled results of the tuning mode
+    ObjectPool<MessageFinalKey> mFinalKeyMessagePool;           ///< Recycled messages sending the keys
+    ObjectPool<MessageTuningDeviation> mDeviationMessagePool;   ///< Recycled messages sending the results
+    SpectrumAccumulator mSpectrumAccumulator;   ///< Streaming spectrum in recording mode
+    double mSubsonicFollower;               ///< State of the streaming subsonic filter
+    Decimator mDecimator;                   ///< Sampling rate reduction of the rolling FFTs
+    WindowStatistics mWindowStatistics;     ///< Running statistics of the rolling window
+
+    FFT_Implementation mFFT;                ///< Instance of the Fourier transformer (double)
+    FFT_ImplementationFloat mFFTFloat;      ///< Instance of the Fourier transformer (float)
 
     FFTAnalyzer mFFTAnalyser;               ///< Instance of the FFT analyzer
     KeyRecognizer mKeyRecognizer;           ///< Instance of the Key recognizer
     OverpullEstimator mOverpull;            ///< Instance of the overpull estimator
     std::map<int,int> mKeyCountStatistics;  ///< Count which key is selected how often
     std::mutex mKeyCountStatisticsMutex;    ///< Corresponding mutex
+    int mConfidentKey;                      ///< Key of the last reliable recognition
+    int mConfidentRecognitions;             ///< Number of subsequent reliable recognitions of this key
+    int mEarlyDecisionKey;                  ///< Key of an early end of the recording, -1 if none
     int mSelectedKey;                       ///< The selected key by the user
     bool mKeyForced;                        ///< Is the key selection forced
     int mInvalidRecoringCounter = 0;        ///< Number of recordings that failed in the current key
 
     std::atomic<AnalyzerRole> mAnalyzerRole;
+
+    friend class SignalAnalyzerTest;        ///< Test of the allocations per FFT
 };
 
 #endif // SIGNALANALYZER_H
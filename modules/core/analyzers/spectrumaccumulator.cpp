@@ -0,0 +1,239 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                       Streaming spectrum accumulator
+//=============================================================================
+
+#include "spectrumaccumulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../system/eptexception.h"
+#include "../system/log.h"
+#include "../math/simdtools.h"
+#include "windowstatistics.h"
+
+//-----------------------------------------------------------------------------
+//                              Constructor
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Constructor, creating an empty accumulator without segments.
+///////////////////////////////////////////////////////////////////////////////
+
+SpectrumAccumulator::SpectrumAccumulator() :
+    mSamplingRate(0),
+    mSegmentSize(0),
+    mHopSize(0),
+    mSegment(),
+    mSegmentFill(0),
+    mAccumulatedSpectrum(),
+    mNumberOfSegments(0),
+    mMaximalAmplitude(0),
+    mSignalDetected(false)
+{}
+
+
+//-----------------------------------------------------------------------------
+//                          Reset the accumulator
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Reset the accumulator and prepare it for a new recording.
+///
+/// Successive segments overlap by 50%. The segment size determines the
+/// frequency resolution of the resulting spectrum.
+/// \param samplingRate : Sampling rate of the incoming signal
+/// \param segmentSize : Number of samples per segment (even)
+///////////////////////////////////////////////////////////////////////////////
+
+void SpectrumAccumulator::reset (int samplingRate, size_t segmentSize)
+{
+    EptAssert(samplingRate > 0, "Sampling rate has to be positive");
+    EptAssert(segmentSize >= 2 and segmentSize % 2 == 0, "Segment size has to be even");
+
+    mSamplingRate = samplingRate;
+    mSegmentSize = segmentSize;
+    mHopSize = segmentSize / 2;
+    mSegment.assign(mSegmentSize, 0);
+    mSegmentFill = 0;
+    mAccumulatedSpectrum.assign(mSegmentSize / 2 + 1, 0);
+    mNumberOfSegments = 0;
+    mMaximalAmplitude = 0;
+    mSignalDetected = false;
+}
+
+
+//-----------------------------------------------------------------------------
+//                          Append new audio data
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Append newly recorded samples.
+///
+/// The samples are copied into the current segment. Whenever a segment
+/// is complete it is transformed and added to the accumulated spectrum.
+/// The second half of the completed segment is kept as the first half
+/// of the next one.
+/// \param data : Vector of newly recorded samples
+///////////////////////////////////////////////////////////////////////////////
+
+void SpectrumAccumulator::append (const FFTRealVector &data)
+{
+    EptAssert(mSegmentSize > 0, "Accumulator has to be reset before use");
+
+    size_t position = 0;
+    while (position < data.size())
+    {
+        const size_t n = std::min(data.size() - position, mSegmentSize - mSegmentFill);
+        for (size_t i = position; i < position + n; ++i)
+            mMaximalAmplitude = std::max(mMaximalAmplitude, std::abs(data[i]));
+        std::memcpy(mSegment.data() + mSegmentFill, data.data() + position, n * sizeof(FFTRealType));
+        mSegmentFill += n;
+        position += n;
+
+        if (mSegmentFill == mSegmentSize)
+        {
+            processSegment();
+            // keep the overlapping part for the next segment
+            std::memmove(mSegment.data(), mSegment.data() + mHopSize,
+                         (mSegmentSize - mHopSize) * sizeof(FFTRealType));
+            mSegmentFill = mSegmentSize - mHopSize;
+        }
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+//                      Get the current power spectrum
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the power spectrum of the signal recorded so far.
+///
+/// The spectrum is the average over all completed segments. The samples of
+/// the incomplete segment which are not yet covered by a completed segment
+/// are included by transforming the zero-padded segment, weighted by its
+/// relative length.
+/// \param powerspectrum : FFTData which will be overwritten by the result
+/// \return true if a spectrum could be computed, false if only silence
+/// was recorded so far.
+///////////////////////////////////////////////////////////////////////////////
+
+bool SpectrumAccumulator::getPowerspectrum (FFTData &powerspectrum)
+{
+    EptAssert(mSegmentSize > 0, "Accumulator has to be reset before use");
+
+    powerspectrum.samplingRate = mSamplingRate;
+    powerspectrum.fft = mAccumulatedSpectrum;
+    double weight = mNumberOfSegments;
+
+    // include the incomplete segment if it contains samples
+    // which have not been analyzed in a completed segment
+    const size_t analyzed = (mNumberOfSegments > 0 ? mSegmentSize - mHopSize : 0);
+    if (mSegmentFill > analyzed and transformSegment(mSegmentFill, mSegmentSpectrum))
+    {
+        const double w = static_cast<double>(mSegmentFill) / mSegmentSize;
+        for (size_t k = 0; k < mSegmentSpectrum.size(); ++k)
+            powerspectrum.fft[k] += w * mSegmentSpectrum[k];
+        weight += w;
+    }
+
+    if (weight <= 0) return false;
+    for (auto &y : powerspectrum.fft) y /= weight;
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+//               Private function: process a completed segment
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Transform a completed segment and add it to the accumulated
+/// spectrum.
+///////////////////////////////////////////////////////////////////////////////
+
+void SpectrumAccumulator::processSegment ()
+{
+    if (not transformSegment(mSegmentSize, mSegmentSpectrum)) return;
+    for (size_t k = 0; k < mSegmentSpectrum.size(); ++k)
+        mAccumulatedSpectrum[k] += mSegmentSpectrum[k];
+    ++mNumberOfSegments;
+}
+
+
+//-----------------------------------------------------------------------------
+//         Private function: preprocess and transform a single segment
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Preprocess and transform the first samples of the current segment.
+///
+/// The dc-bias is removed and the segment is faded in and out. The resulting
+/// power spectrum is normalized by the energy of the segment. As long as no
+/// signal has been detected, segments with an energy below the silence
+/// threshold are rejected.
+/// \param size : Number of samples to be used, the rest is zero-padded.
+/// \param powerspectrum : Resulting power spectrum of size mSegmentSize/2+1.
+/// \return true on success, false if the segment is silent.
+///////////////////////////////////////////////////////////////////////////////
+
+bool SpectrumAccumulator::transformSegment (size_t size, FFTRealVector &powerspectrum)
+{
+    EptAssert(size > 0 and size <= mSegmentSize, "Invalid segment size");
+
+    // 1. Remove dc-bias and determine the energy of the segment
+    double mean = 0;
+    for (size_t i = 0; i < size; ++i) mean += mSegment[i];
+    mean /= size;
+    double energy = 0;
+    for (size_t i = 0; i < size; ++i) energy += (mSegment[i] - mean) * (mSegment[i] - mean);
+    if (energy <= 0) return false;
+
+    // 2. Skip silence at the beginning
+    if (not mSignalDetected)
+    {
+        if (energy / size < WindowStatistics::getSilenceTrigger(mMaximalAmplitude)) return false;
+        mSignalDetected = true;
+    }
+
+    // 3. Copy directly into the input buffer of the FFT,
+    //    fade in and out at the boundaries, and pad with zeros
+    FFTRealType *input = mFFT.getInputBuffer(mSegmentSize);
+    for (size_t i = 0; i < size; ++i) input[i] = mSegment[i] - mean;
+    std::fill(input + size, input + mSegmentSize, 0);
+    const size_t blocksize = size / 50;
+    for (size_t i = 0; i < blocksize; ++i)
+    {
+        input[i]            *= static_cast<double>(i) / blocksize;
+        input[size - i - 1] *= static_cast<double>(i) / blocksize;
+    }
+
+    // 4. Transform and compute the normalized power spectrum
+    const FFTComplexType *output = mFFT.execute();
+    powerspectrum.resize(mSegmentSize / 2 + 1);
+    SimdTools::computePowerSpectrum(output, powerspectrum.data(), powerspectrum.size());
+    const double norm = 1.0 / (energy * size);
+    for (auto &y : powerspectrum) y *= norm;
+    return true;
+}
@@ -0,0 +1,88 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                       Streaming spectrum accumulator
+//=============================================================================
+
+#ifndef SPECTRUMACCUMULATOR_H
+#define SPECTRUMACCUMULATOR_H
+
+#include "prerequisites.h"
+#include "../math/fftadapter.h"
+#include "../math/fftimplementation.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Streaming accumulator for the power spectrum of a keystroke
+///
+/// While a key is being recorded the SignalAnalyzer has to provide an
+/// up-to-date power spectrum in regular intervals. Instead of transforming
+/// the entire recorded signal again and again, the accumulator follows
+/// the method of Welch: The incoming signal is cut into overlapping
+/// segments of fixed length. Each segment is transformed exactly once as
+/// soon as it is complete and its power spectrum is added to a running sum.
+/// The current incomplete segment is zero-padded and transformed on demand.
+/// Hence the work per update is bounded by the segment size and does not
+/// grow with the duration of the recording.
+///
+/// Each segment is preprocessed individually: The dc-bias is removed,
+/// the segment is faded in and out at its boundaries, and its power is
+/// normalized by the segment energy. The latter mirrors the constant-volume
+/// preprocessing of the full signal so that the decaying tail of a note
+/// contributes with the same weight as the attack. Silent segments at the
+/// beginning are skipped, using the trigger of the WindowStatistics.
+///
+/// The resulting spectrum is delivered as FFTData of size segmentSize/2+1
+/// and can be passed to the KeyRecognizer unchanged. Its resolution is
+/// limited by the segment size, the final analysis of a keystroke is
+/// therefore based on a transformation of the complete signal.
+///////////////////////////////////////////////////////////////////////////////
+
+class EPT_EXTERN SpectrumAccumulator
+{
+public:
+    SpectrumAccumulator();
+    ~SpectrumAccumulator() {}
+
+    void reset (int samplingRate, size_t segmentSize);
+    void append (const FFTRealVector &data);
+    bool getPowerspectrum (FFTData &powerspectrum);
+
+    size_t getSegmentSize() const { return mSegmentSize; }      ///< Get the segment size
+    int getNumberOfSegments() const { return mNumberOfSegments; }  ///< Number of accumulated segments
+
+private:
+    void processSegment ();
+    bool transformSegment (size_t size, FFTRealVector &powerspectrum);
+
+    int mSamplingRate;                  ///< Sampling rate of the incoming signal
+    size_t mSegmentSize;                ///< Size of a segment (length of the FFT)
+    size_t mHopSize;                    ///< Distance between subsequent segments
+    FFTRealVector mSegment;             ///< Samples of the current segment
+    size_t mSegmentFill;                ///< Number of samples in the current segment
+    FFTRealVector mAccumulatedSpectrum; ///< Sum of the completed segment spectra
+    int mNumberOfSegments;              ///< Number of completed and accumulated segments
+    double mMaximalAmplitude;           ///< Largest amplitude seen so far
+    bool mSignalDetected;               ///< True if a non-silent segment was found
+
+    FFT_Implementation mFFT;            ///< Instance of the Fourier transformer
+    FFTRealVector mSegmentSpectrum;     ///< Power spectrum of a single segment
+};
+
+#endif // SPECTRUMACCUMULATOR_H
@@ -0,0 +1,197 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//               Running statistics of the rolling signal window
+//=============================================================================
+
+#include "windowstatistics.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../system/eptexception.h"
+
+//-----------------------------------------------------------------------------
+//                              Constructor
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Constructor, creating empty statistics.
+///////////////////////////////////////////////////////////////////////////////
+
+WindowStatistics::WindowStatistics() :
+    mSectionWidth(1),
+    mSize(0),
+    mSections(1),
+    mFirst(0),
+    mCount(0)
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Remove all samples and set the width of the sections.
+///
+/// The ring of sections is allocated here. Since the sections are aligned
+/// to the stream, two additional sections are required for the incomplete
+/// ones at both ends.
+/// \param sectionWidth : Number of samples per section
+/// \param capacity : Maximal number of registered samples, i.e., the size
+/// of the window plus the number of samples appended before restrict()
+/// is called.
+///////////////////////////////////////////////////////////////////////////////
+
+void WindowStatistics::reset (size_t sectionWidth, size_t capacity)
+{
+    mSectionWidth = std::max<size_t>(1, sectionWidth);
+    mSize = 0;
+    mSections.assign(capacity / mSectionWidth + 2, Section());
+    mFirst = 0;
+    mCount = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+//                           Register new samples
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Register newly arrived samples.
+///
+/// The samples complete the newest section, further sections are opened
+/// as required.
+/// \param samples : Pointer to the new samples
+/// \param n : Number of new samples
+///////////////////////////////////////////////////////////////////////////////
+
+void WindowStatistics::append (const FFTWType *samples, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (mCount == 0 or getSection(mCount - 1).length >= mSectionWidth)
+        {
+            EptAssert(mCount < mSections.size(), "Capacity of the window statistics exceeded");
+            getSection(mCount++) = {0, 0, 0};
+        }
+        Section &section = getSection(mCount - 1);
+        const double s = samples[i];
+        section.energy += s * s;
+        section.maximum = std::max(section.maximum, std::fabs(s));
+        ++section.length;
+    }
+    mSize += n;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Drop the samples which have left the window.
+///
+/// Sections lying completely before the window are removed. If the window
+/// starts inside the oldest section, its statistics are recomputed from the
+/// remaining samples.
+/// \param window : Pointer to the samples of the window, oldest first
+/// \param size : Number of samples in the window
+///////////////////////////////////////////////////////////////////////////////
+
+void WindowStatistics::restrict (const FFTWType *window, size_t size)
+{
+    EptAssert(size <= mSize, "The window contains unregistered samples");
+    while (mCount > 0 and mSize - getSection(0).length >= size)
+    {
+        mSize -= getSection(0).length;
+        mFirst = (mFirst + 1) % mSections.size();
+        --mCount;
+    }
+    if (mSize > size)
+    {
+        Section &section = getSection(0);
+        section.length -= mSize - size;
+        section.energy = 0;
+        section.maximum = 0;
+        for (size_t i = 0; i < section.length; ++i)
+        {
+            section.energy += window[i] * window[i];
+            section.maximum = std::max(section.maximum, std::fabs(window[i]));
+        }
+        mSize = size;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+//                           Evaluate the statistics
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Check whether the window contains a non-vanishing sample.
+/// \return True if there is a signal
+///////////////////////////////////////////////////////////////////////////////
+
+bool WindowStatistics::hasSignal () const
+{
+    for (size_t i = 0; i < mCount; ++i) if (getSection(i).maximum > 0) return true;
+    return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Number of silent samples at the beginning of the window.
+///
+/// The leading sections are silent if their mean energy lies below the
+/// trigger returned by getSilenceTrigger for the maximal amplitude in the
+/// window. At least two complete sections are required,
+/// the incomplete newest section is never skipped.
+/// \return Number of samples to be skipped
+///////////////////////////////////////////////////////////////////////////////
+
+size_t WindowStatistics::getLeadingSilence () const
+{
+    if (mSize < 2 * mSectionWidth) return 0;
+
+    double maxamplitude = 0;
+    for (size_t i = 0; i < mCount; ++i) maxamplitude = std::max(maxamplitude, getSection(i).maximum);
+    const double trigger = getSilenceTrigger(maxamplitude);
+
+    size_t silence = 0;
+    for (size_t i = 0; i < mCount; ++i)
+    {
+        const Section &section = getSection(i);
+        if (i == mCount - 1 and section.length < mSectionWidth) break;
+        if (section.energy / section.length < trigger) silence += section.length;
+        else break;
+    }
+    return silence;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Energy per sample below which a section counts as silent.
+///
+/// The trigger scales with the squared maximal amplitude of the signal
+/// but is bounded from above, so that loud background noise is not
+/// mistaken for a keystroke. It is shared with the SpectrumAccumulator.
+/// \param maxamplitude : Maximal absolute amplitude of the signal
+/// \return Trigger for the mean squared amplitude of a section
+///////////////////////////////////////////////////////////////////////////////
+
+double WindowStatistics::getSilenceTrigger (double maxamplitude)
+{
+    return std::min(0.2, maxamplitude * maxamplitude / 100);
+}
@@ -0,0 +1,87 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//               Running statistics of the rolling signal window
+//=============================================================================
+
+#ifndef WINDOWSTATISTICS_H
+#define WINDOWSTATISTICS_H
+
+#include <vector>
+
+#include "prerequisites.h"
+#include "../math/fftadapter.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Running statistics of the samples in the rolling window
+///
+/// In the tuning mode the SignalAnalyzer transforms the most recent few
+/// seconds of the signal in regular intervals. Before each transformation
+/// it has to know whether the window contains any signal at all and how
+/// many silent samples at its beginning can be skipped. Instead of
+/// scanning the whole window again for each FFT, this class keeps the
+/// energy and the maximal amplitude of short sections of the stream. New
+/// samples are registered once as they arrive, sections leaving the window
+/// are dropped. The work per FFT is therefore proportional to the number
+/// of sections, not to the number of samples.
+///
+/// The sections are aligned to the stream rather than to the beginning of
+/// the window. The oldest section may thus be incomplete, its statistics
+/// are recomputed from the window data when samples leave the window.
+///
+/// The sections are kept in a ring of fixed capacity which is allocated
+/// by reset(), so that registering samples never allocates memory.
+///////////////////////////////////////////////////////////////////////////////
+
+class EPT_EXTERN WindowStatistics
+{
+public:
+    WindowStatistics();
+    ~WindowStatistics() {}
+
+    void reset (size_t sectionWidth, size_t capacity);
+    void append (const FFTWType *samples, size_t n);
+    void restrict (const FFTWType *window, size_t size);
+
+    bool hasSignal () const;
+    size_t getLeadingSilence () const;
+
+    static double getSilenceTrigger (double maxamplitude);
+
+private:
+    /// Statistics of a section of the stream
+    struct Section
+    {
+        size_t length;              ///< Number of samples in the section
+        double energy;              ///< Sum of the squared samples
+        double maximum;             ///< Maximal absolute amplitude
+    };
+
+    Section &getSection (size_t i) { return mSections[(mFirst + i) % mSections.size()]; }
+    const Section &getSection (size_t i) const { return mSections[(mFirst + i) % mSections.size()]; }
+
+    size_t mSectionWidth;           ///< Number of samples of a complete section
+    size_t mSize;                   ///< Total number of registered samples
+    std::vector<Section> mSections; ///< Ring of sections
+    size_t mFirst;                  ///< Index of the oldest section in the ring
+    size_t mCount;                  ///< Number of sections in use
+};
+
+#endif // WINDOWSTATISTICS_H
@@ -40,9 +40,19 @@
 /// in order to keep the maximum size constant.
 ///
 /// The current content of the buffer can be retrieved as a time-ordered vector
-/// by calling the function getOrderedData().
+/// by calling the function getOrderedData(). In order to avoid copies,
+/// the content can also be accessed in place by calling spans(), which
+/// returns the two contiguous segments of the data in time order.
 ///
-/// The circular buffer is used by the AudioRecorder and the SignalAnalyzer.
+/// In the mirrored mode each element is stored twice, at its position in
+/// the first half and in the second half of an internal array of twice
+/// the maximum size. Then the complete time-ordered content is a single
+/// contiguous range (the second span is always empty) and can be accessed
+/// by contiguousData(). The mirrored mode doubles the memory and the
+/// cost of writing, so it is meant for short buffers which are read
+/// completely and frequently.
+///
+/// The circular buffer is used by the SignalAnalyzer.
 ///
 /// This class contains of a header file only. There is no corresponding
 /// implementation (cpp) file.
@@ -52,22 +62,46 @@ template <class data_type>
 class CircularBuffer
 {
 public:
-    CircularBuffer(std::size_t maximum_size = 0);   ///< Construct an empty buffer of maximal size zero
+    /// Contiguous range of data in the buffer
+    struct Span
+    {
+        const data_type *data;      ///< Pointer to the first element
+        std::size_t size;           ///< Number of elements
+    };
+
+    /// Content of the buffer in time order, given by two contiguous ranges
+    struct Spans
+    {
+        Span first;                 ///< Older part of the data
+        Span second;                ///< Newer part of the data (may be empty)
+        std::size_t size() const { return first.size + second.size; }
+    };
+
+    CircularBuffer(std::size_t maximum_size = 0,
+                   bool mirrored = false);          ///< Construct an empty buffer of maximal size zero
 
     void clear();                                   ///< Clear the buffer, keeping its maximal size
     void push_back(const data_type &data);          ///< Append a new data element to the buffer
+    void append(const data_type *data, std::size_t n);  ///< Append n data elements to the buffer
     void resize(std::size_t maximum_size);          ///< Resize the buffer, shrink oldest data if necessary
+    void setMirrored(bool mirrored);                ///< Switch the mirrored mode on or off
+    Spans spans() const;                            ///< Access the time-ordered data in place
+    const data_type *contiguousData() const;        ///< Access the time-ordered data (mirrored mode)
     std::vector<data_type> getOrderedData() const;  ///< Copy entire data in a time-ordered form
     std::vector<data_type> readData(size_t n);      ///< Retrieve time-ordeded data with maximum size of n and remove if from the buffer
     std::size_t size() const {return mCurrentSize;} ///< Return current buffer size
     std::size_t maximum_size() const
         {return mMaximumSize;}                      ///< Return actual maximal size
+    bool isMirrored() const {return mMirrored;}     ///< Return true in the mirrored mode
 
 private:
+    void copyOrderedData(data_type *out, std::size_t n) const;  // Copy the newest n elements
+
     std::size_t mCurrentWritePosition;              ///< Current read position
     std::size_t mCurrentReadPosition;               ///< Current write position
     std::size_t mMaximumSize;                       ///< Maximal size of the buffer
     std::size_t mCurrentSize;                       ///< Current size of the buffer
+    bool mMirrored;                                 ///< Each element is stored twice
     std::vector<data_type> mData;                   ///< Internal cyclic data buffer
 };
 
@@ -81,17 +115,20 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////
 /// Default constructor, creating an empty buffer with maximal size zero.
+/// \param maximum_size : Maximal size of the buffer.
+/// \param mirrored : Store the data in the mirrored mode.
 ///////////////////////////////////////////////////////////////////////////////
 
 template <class data_type>
-CircularBuffer<data_type>::CircularBuffer(std::size_t maximum_size)
+CircularBuffer<data_type>::CircularBuffer(std::size_t maximum_size, bool mirrored)
     : mCurrentWritePosition(0),
       mCurrentReadPosition(0),
       mMaximumSize(maximum_size),
       mCurrentSize(0),
+      mMirrored(mirrored),
       mData()
 {
-    mData.resize(mMaximumSize);
+    mData.resize(mMirrored ? 2 * mMaximumSize : mMaximumSize);
 }
 
 
@@ -131,15 +168,96 @@ void CircularBuffer<data_type>::push_back(const data_type &data)
     assert(mCurrentReadPosition < mMaximumSize);
     // write at the desired position
     mData[mCurrentWritePosition] = data;
+    if (mMirrored) mData[mCurrentWritePosition + mMaximumSize] = data;
     // update write pointer
-    mCurrentWritePosition = (mCurrentWritePosition+1) % mMaximumSize;
-    // update current size
-    mCurrentSize = std::min(mCurrentSize + 1, mMaximumSize);
-    // update read pointer (add mMaximumSize to keep it positive)
+    if (++mCurrentWritePosition == mMaximumSize) mCurrentWritePosition = 0;
+    // update current size, if the buffer is full the oldest element is dropped
+    if (mCurrentSize < mMaximumSize) ++mCurrentSize;
+    else mCurrentReadPosition = mCurrentWritePosition;
+}
+
+
+//-----------------------------------------------------------------------------
+//                       Append several data elements
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// This function appends n elements by at most two memcpy operations
+/// (four in the mirrored mode). If the maximum size is exceeded the oldest
+/// data is overwritten. If n exceeds the maximum size, only the last
+/// elements are kept.
+/// \param data : Pointer to the new data elements.
+/// \param n : Number of elements to be added.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+void CircularBuffer<data_type>::append(const data_type *data, std::size_t n)
+{
+    if (n == 0) return;
+    assert(mMaximumSize > 0);
+    if (n > mMaximumSize)
+    {
+        data += n - mMaximumSize;
+        n = mMaximumSize;
+    }
+
+    // write the data, wrapping around at the end
+    const std::size_t part1Size = std::min(n, mMaximumSize - mCurrentWritePosition);
+    std::memcpy(mData.data() + mCurrentWritePosition, data, part1Size * sizeof(data_type));
+    std::memcpy(mData.data(), data + part1Size, (n - part1Size) * sizeof(data_type));
+    if (mMirrored)
+    {
+        std::memcpy(mData.data() + mMaximumSize + mCurrentWritePosition, data, part1Size * sizeof(data_type));
+        std::memcpy(mData.data() + mMaximumSize, data + part1Size, (n - part1Size) * sizeof(data_type));
+    }
+
+    // update pointers and size
+    mCurrentWritePosition = (mCurrentWritePosition + n) % mMaximumSize;
+    mCurrentSize = std::min(mCurrentSize + n, mMaximumSize);
     mCurrentReadPosition = (mCurrentWritePosition + mMaximumSize - mCurrentSize) % mMaximumSize;
 }
 
 
+//-----------------------------------------------------------------------------
+//                       Access the data in place
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Since the buffer is written cyclically, the content consists of two
+/// contiguous parts in general. This function returns both parts in
+/// temporal order without copying the data. In the mirrored mode the
+/// second part is always empty. The spans remain valid until the
+/// buffer is modified.
+///
+/// \return Two spans which together hold the content in time order.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+typename CircularBuffer<data_type>::Spans CircularBuffer<data_type>::spans() const
+{
+    const std::size_t part1Size = (mMirrored ? mCurrentSize :
+        std::min(mCurrentReadPosition + mCurrentSize, mMaximumSize) - mCurrentReadPosition);
+    return {{mData.data() + mCurrentReadPosition, part1Size},
+            {mData.data(), mCurrentSize - part1Size}};
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// In the mirrored mode the complete content of the buffer is a single
+/// contiguous range of size() elements. This function returns a pointer
+/// to its beginning which remains valid until the buffer is modified.
+///
+/// \return Pointer to the oldest element of the time-ordered data.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+const data_type *CircularBuffer<data_type>::contiguousData() const
+{
+    EptAssert(mMirrored, "Contiguous access requires the mirrored mode.");
+    return mData.data() + mCurrentReadPosition;
+}
+
+
 //-----------------------------------------------------------------------------
 //                      Copy data in an ordered form
 //-----------------------------------------------------------------------------
@@ -158,19 +276,11 @@ template <class data_type>
 std::vector<data_type> CircularBuffer<data_type>::getOrderedData() const
 {
     std::vector<data_type> data_out(mCurrentSize);
-    // copy end
-    std::size_t part1Size = std::min(mCurrentReadPosition + mCurrentSize, mMaximumSize) - mCurrentReadPosition;
-    std::memcpy(data_out.data(), mData.data() + mCurrentReadPosition, part1Size * sizeof(data_type));
-
-    // copy start
-    std::size_t part2Size = mCurrentSize - part1Size;
-    std::memcpy(data_out.data() + part1Size, mData.data(), part2Size * sizeof(data_type));
-
+    copyOrderedData(data_out.data(), mCurrentSize);
     return data_out;
 }
 
 
-
 //-----------------------------------------------------------------------------
 //  Retrieve time-ordeded data with max size of n and remove if from the buffer
 //-----------------------------------------------------------------------------
@@ -184,14 +294,17 @@ std::vector<data_type> CircularBuffer<data_type>::getOrderedData() const
 template <class data_type>
 std::vector<data_type> CircularBuffer<data_type>::readData(size_t n)
 {
-    std::vector<data_type> data_out(std::move(getOrderedData()));
-    if (data_out.size() > n) data_out.resize(n);
-
-    EptAssert(mCurrentSize >= data_out.size(), "Do not read more data than existent.");
+    const Spans content = spans();
+    const std::size_t count = std::min(n, mCurrentSize);
+    std::vector<data_type> data_out(count);
+    if (count == 0) return data_out;
+    const std::size_t part1Size = std::min(count, content.first.size);
+    std::memcpy(data_out.data(), content.first.data, part1Size * sizeof(data_type));
+    std::memcpy(data_out.data() + part1Size, content.second.data, (count - part1Size) * sizeof(data_type));
 
     // reset read position
-    mCurrentReadPosition = (mCurrentReadPosition + data_out.size()) % mMaximumSize;
-    mCurrentSize = mCurrentSize - data_out.size();
+    mCurrentReadPosition = (mCurrentReadPosition + count) % mMaximumSize;
+    mCurrentSize = mCurrentSize - count;
 
     return data_out;
 }
@@ -211,24 +324,73 @@ std::vector<data_type> CircularBuffer<data_type>::readData(size_t n)
 template <class data_type>
 void CircularBuffer<data_type>::resize(std::size_t maximum_size)
 {
-    // we have to temporarily store the old data and rewrite at at position 0
-    std::vector<data_type> old_data(std::move(getOrderedData()));
-    mMaximumSize = maximum_size;
-    // new current size is size of old data, or smaller)
-    mCurrentSize = std::min(old_data.size(), maximum_size);
-    // resize or internal data structure
-    mData.resize(mMaximumSize);
+    // copy the newest data directly to the beginning of the new array
+    const std::size_t newSize = std::min(mCurrentSize, maximum_size);
+    std::vector<data_type> new_data(mMirrored ? 2 * maximum_size : maximum_size);
+    copyOrderedData(new_data.data(), newSize);
+    if (mMirrored) std::memcpy(new_data.data() + maximum_size, new_data.data(), newSize * sizeof(data_type));
 
-    // dont copy data if new buffer is empty
-    if (mMaximumSize == 0) return;
+    mData.swap(new_data);
+    mMaximumSize = maximum_size;
+    mCurrentSize = newSize;
 
     // reset read and write pointers
     mCurrentReadPosition = 0;
-    mCurrentWritePosition = mCurrentSize % mMaximumSize;
-    // copy the old data
-    std::memcpy(mData.data(),
-                old_data.data() + (old_data.size() - mCurrentSize),
-                mCurrentSize * sizeof(data_type));
+    mCurrentWritePosition = (mMaximumSize > 0 ? mCurrentSize % mMaximumSize : 0);
+}
+
+
+//-----------------------------------------------------------------------------
+//                      Switch the mirrored mode on or off
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Switch the mirrored mode on or off. The content is kept.
+/// \param mirrored : True for the mirrored mode.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+void CircularBuffer<data_type>::setMirrored(bool mirrored)
+{
+    if (mirrored == mMirrored) return;
+    if (mirrored)
+    {
+        mData.resize(2 * mMaximumSize);
+        if (mMaximumSize > 0)
+            std::memcpy(mData.data() + mMaximumSize, mData.data(), mMaximumSize * sizeof(data_type));
+    }
+    else
+    {
+        mData.resize(mMaximumSize);
+        mData.shrink_to_fit();
+    }
+    mMirrored = mirrored;
+}
+
+
+//-----------------------------------------------------------------------------
+//               Private function: copy data in an ordered form
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Copy the newest n elements in time order.
+/// \param out : Array of at least n elements receiving the data.
+/// \param n : Number of elements, at most size().
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+void CircularBuffer<data_type>::copyOrderedData(data_type *out, std::size_t n) const
+{
+    EptAssert(n <= mCurrentSize, "Do not copy more data than existent.");
+    if (n == 0) return;
+    const Spans content = spans();
+    // skip the oldest elements
+    const std::size_t skip = mCurrentSize - n;
+    const std::size_t part1Size = content.first.size - std::min(skip, content.first.size);
+    const data_type *part1 = content.first.data + (content.first.size - part1Size);
+    const data_type *part2 = content.second.data + (skip - std::min(skip, content.first.size));
+    std::memcpy(out, part1, part1Size * sizeof(data_type));
+    std::memcpy(out + part1Size, part2, (n - part1Size) * sizeof(data_type));
 }
 
 //-----------------------------------------------------------------------------
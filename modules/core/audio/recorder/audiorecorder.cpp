@@ -55,6 +55,9 @@ const double  AudioRecorder::LEVEL_CUTOFF = 0.9;
 /// dB shift for off mark (high value = shorter recording)
 const double AudioRecorder::DB_OFF = 2;
 
+/// Wakeup threshold indicating that no thread is waiting for data.
+const size_t AudioRecorder::NO_WAKEUP = std::numeric_limits<size_t>::max();
+
 
 //-----------------------------------------------------------------------------
 //                             Constructor
@@ -76,6 +79,8 @@ AudioRecorder::AudioRecorder() :
       mPacketCounter(0),        // Counter for the number of packages
       mIntensityHistogram(),    // Histogram of intensities for level control
       mCurrentPacket(0),        // Local audio buffer
+      mDataAvailable(),         // Event waking up the reading thread
+      mWakeupThreshold(NO_WAKEUP), // Nobody is waiting for data
       mStroboscope(this)
 {
 }
@@ -150,22 +155,102 @@ void AudioRecorder::setMuted (bool muted)
 }
 
 //-----------------------------------------------------------------------------
-//                      Read all data from the buffer
+//                      Read data from the buffer
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Read all data from the internal buffer
+/// \brief Access all data in the internal buffer
+///
+/// Provides the buffered data in place as two contiguous spans without
+/// copying it. The data remains valid until it is removed by releaseData().
+/// This function is called by the SignalAnalyzer.
+/// \return Spans holding the buffered data in time order.
+///////////////////////////////////////////////////////////////////////////////
+
+AudioRecorder::SpansType AudioRecorder::readData() const
+{
+    return mCurrentPacket.read();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Remove data from the internal buffer after processing
 ///
-/// Reads all data from the internal buffer into the packet vector and clears
-/// the internal buffer. This function is called by the SignalAnalyzer.
-/// \param packet : Reference to the packet where the new data is stored.
+/// If the buffer was full since the last call and incoming audio data had
+/// to be dropped, a warning is written to the log.
+/// \param n : Number of processed PCM values, usually the size of the spans
+/// returned by readData().
 ///////////////////////////////////////////////////////////////////////////////
 
-void AudioRecorder::readAll(PacketType &packet)
+void AudioRecorder::releaseData(size_t n)
 {
-    std::lock_guard<std::mutex> lock(mCurrentPacketMutex);   // lock the function
-    packet = mCurrentPacket.getOrderedData();               // copy the content
-    mCurrentPacket.clear();                                 // clear audio buffer
+    mCurrentPacket.release(n);
+    const size_t dropped = mCurrentPacket.takeDroppedCount();
+    if (dropped > 0) LogW("Audio buffer overflow, %d PCM values dropped", static_cast<int>(dropped));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Remove all data from the internal buffer
+///////////////////////////////////////////////////////////////////////////////
+
+void AudioRecorder::clearData()
+{
+    mCurrentPacket.discard();
+    mCurrentPacket.takeDroppedCount();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Sleep until a certain amount of data is available
+///
+/// The calling thread sleeps without consuming CPU time until the audio
+/// thread has pushed enough data, until interruptWait() is called, or until
+/// the deadline has passed, whatever happens first. Passing NO_WAKEUP as
+/// the amount of data simply waits for the deadline or an interruption.
+/// \param n : Number of PCM values which have to be in the buffer
+/// \param deadline : Point in time at which the function returns at the latest
+/// \return true if the requested amount of data is available
+///////////////////////////////////////////////////////////////////////////////
+
+bool AudioRecorder::waitForData(size_t n, WakeupEvent::Clock::time_point deadline)
+{
+    mWakeupThreshold = n;
+    if (mCurrentPacket.size() < n) mDataAvailable.waitUntil(deadline);
+    mWakeupThreshold = NO_WAKEUP;
+    return mCurrentPacket.size() >= n;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Wake up a thread sleeping in waitForData
+///
+/// This function is called when the reading thread has to react
+/// immediately, e.g. when it is stopped.
+///////////////////////////////////////////////////////////////////////////////
+
+void AudioRecorder::interruptWait()
+{
+    mDataAvailable.notify();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief End the recording before the level drops.
+///
+/// The SignalAnalyzer calls this function as soon as it has identified the
+/// key reliably. The recording ends in the same way as if the level had
+/// dropped, except that it cannot be retriggered until the level falls
+/// below LEVEL_RETRIGGER, since the key is still sounding.
+///////////////////////////////////////////////////////////////////////////////
+
+void AudioRecorder::finishRecording()
+{
+    // the audio thread may end the recording at the same time
+    if (not mRecording.exchange(false)) return;
+    mRestartable = false;
+    MessageHandler::send(Message::MSG_RECORDING_ENDED);
+    LogI("Recording finished early");
 }
 
 
@@ -219,12 +304,14 @@ void AudioRecorder::pushRawData(const PacketType &data)
     // Forward packet to the stroboscope
     mStroboscope.pushRawData (data);
 
-    std::lock_guard<std::mutex> lock(mCurrentPacketMutex);
+    // Copy the packet to the lock-free buffer and wake up
+    // the reading thread if it is waiting for this data
+    mCurrentPacket.write(data.data(), data.size());
+    if (mCurrentPacket.size() >= mWakeupThreshold) mDataAvailable.notify();
 
     // loop over all PCM values of the incoming data vector
     for (auto &pcmvalue : data)
     {
-        mCurrentPacket.push_back(pcmvalue);
         mPacketM1 += pcmvalue;
         mPacketM2 += pcmvalue*pcmvalue;
 
@@ -354,9 +441,8 @@ void AudioRecorder::controlRecordingState (double level)
     // check for recording end
     // ------------------------------------------------------------------------
 
-    if (mRecording and level < mStopLevel)
+    if (level < mStopLevel and mRecording.exchange(false))
     {
-        mRecording   = false;
         mRestartable = true;
         MessageHandler::send(Message::MSG_RECORDING_ENDED);
         LogI("Recording stopped");
@@ -382,41 +468,3 @@ void AudioRecorder::controlRecordingState (double level)
         MessageHandler::send(Message::MSG_RECORDING_STARTED);
     }
 }
-
-
-//-----------------------------------------------------------------------------
-//               Cut away silence at the beginning of the buffer
-//-----------------------------------------------------------------------------
-
-///////////////////////////////////////////////////////////////////////////////
-/// \brief Cut trailing silence
-///
-/// The local buffer of the adapter has a length of a few seconds. When the
-/// recording starts, the buffer will contain a period of silence before
-/// the key was hit. This function removes this part of the vector.
-/// \param packet : The packet with the audio PCM data (call by reference)
-///////////////////////////////////////////////////////////////////////////////
-
-void AudioRecorder::cutSilence (PacketType &packet)
-{
-    // determine the maximum amplitude in the packet
-    double maxamplitude = 0;
-    for (auto &y : packet) if (fabs(y)>maxamplitude) maxamplitude = fabs(y);
-    double trigger = std::min(0.2,maxamplitude*maxamplitude/100);
-
-    int w = getSampleRate() / 40;           // section width of 0.025 sec
-    int sections = static_cast<int>(packet.size()) / w;         // number of sections
-    if (sections < 2) return;                 // required: at least two sections
-    size_t entries_to_delete = 0;             // number of sections to be deleted
-    for (int sec = 0; sec < sections; ++sec)  // scan sectors
-    {
-        double energy = 0;
-        for (int i = sec*w; i < (sec+1)*w; ++i) energy += packet[i] * packet[i];
-        if (energy / w < trigger) entries_to_delete += w;
-        else break;
-    }
-    // Remove the first silent sectors:
-    EptAssert(entries_to_delete <= packet.size(),"inconsistent numbers of elements");
-    if (entries_to_delete > 0)
-        packet.erase(packet.begin(), packet.begin() + entries_to_delete);
-}
@@ -22,20 +22,25 @@
 
 #include "prerequisites.h"
 #include "../pcmdevice.h"
-#include "../circularbuffer.h"
+#include "../spscringbuffer.h"
 #include "stroboscope.h"
+#include "../../system/wakeupevent.h"
 //#include "../../messages/messagelistener.h"
 
 #include <vector>
 #include <map>
-#include <mutex>
+#include <atomic>
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Abstract adapter class for recording audio signals
 ///
-/// The class has an internal circlar buffer which holds the incoming
-/// audio data for a maximum of a few seconds. The user can retrieve
-/// the data in form of vector (packet) by calling readAll(&packet).
+/// The class has an internal ring buffer which holds the incoming
+/// audio data for a maximum of a few seconds. The SignalAnalyzer accesses
+/// the data in place by calling readData() and removes it afterwards by
+/// calling releaseData(). The ring buffer is lock-free, so that the audio
+/// thread is never blocked by the SignalAnalyzer. Instead of polling, the
+/// SignalAnalyzer sleeps in waitForData() until the audio thread wakes it
+/// up as soon as the requested amount of data has arrived.
 ///
 /// This class has to be implemented by the actual sound device
 /// implementation (AudioRecorderForQt). The implementation has to
@@ -54,6 +59,9 @@ public:
     /// Type definition of a PCM packet (vector of PCM values).
     typedef std::vector<PCMDataType> PacketType;
 
+    /// Type definition of the buffered data (two contiguous ranges).
+    typedef SPSCRingBuffer<PCMDataType>::Spans SpansType;
+
     // Static constants, explained in the source file:
 
     static const int    BUFFER_SIZE_IN_SECONDS;     // size of circular buffer
@@ -64,6 +72,7 @@ public:
     static const double LEVEL_TRIGGER;              // level where rec. starts
     static const double LEVEL_CUTOFF;               // highest allowed level
     static const double DB_OFF;                     // dB shift for off mark
+    static const size_t NO_WAKEUP;                  // nobody waits for data
 
 public:
     AudioRecorder();                 ///< Constructor
@@ -71,8 +80,12 @@ public:
 
     virtual void open(AudioInterface *audioInterface) override final;
 
-    void readAll(PacketType &packet);       // Read all buffered data
-    void cutSilence (PacketType &packet);   // Cut off trailing silence
+    SpansType readData() const;             // Access all buffered data
+    void releaseData(size_t n);             // Remove processed data
+    void clearData();                       // Remove all buffered data
+    bool waitForData(size_t n, WakeupEvent::Clock::time_point deadline);  // Sleep until data arrives
+    void interruptWait();                   // Wake up waitForData
+    void finishRecording();                 // End the recording before the level drops
 
     void resetInputLevelControl();          // Reset level control
     double getStopLevel() const { return mStopLevel; }
@@ -104,16 +117,17 @@ private:
     double mPacketM2;           ///< Second intensity moment of a single packet
     double mSlidingLevel;       ///< Sliding VU level of the signal
     double mStopLevel;          ///< Level at which recording stops
-    bool   mRecording;          ///< Flag true if recording is on
-    bool   mRestartable;        ///< Flag true if start/retriggering possible
+    std::atomic<bool> mRecording;   ///< Flag true if recording is on
+    std::atomic<bool> mRestartable; ///< Flag true if start/retriggering possible
     bool   mWaiting;            ///< Wait for the data analysis to be completed
     bool   mStandby;            ///< Standby flag
     int    mPacketCounter;      ///< Counter for the number of packages
 
     std::map <int,double> mIntensityHistogram;      ///< Histogram of intensities
 
-    CircularBuffer<PCMDataType> mCurrentPacket;  ///< Local audio buffer
-    mutable std::mutex mCurrentPacketMutex;         ///< Buffer access mutexbo
+    SPSCRingBuffer<PCMDataType> mCurrentPacket;     ///< Local audio buffer (lock-free)
+    WakeupEvent mDataAvailable;                     ///< Wakes up the reading thread
+    std::atomic<size_t> mWakeupThreshold;           ///< Amount of data awaited by the reading thread
 
     Stroboscope mStroboscope;      ///< Instance of stroboscope
 
@@ -0,0 +1,268 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//             Lock-free single-producer single-consumer ring buffer
+//=============================================================================
+
+#ifndef SPSCRINGBUFFER_H
+#define SPSCRINGBUFFER_H
+
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+
+#include "prerequisites.h"
+#include "core/system/eptexception.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Template class for a lock-free single-producer single-consumer
+/// ring buffer.
+///
+/// The ring buffer transfers data from exactly one producer thread (the
+/// audio callback) to exactly one consumer thread (the SignalAnalyzer)
+/// without any mutex. Writing is wait-free: The producer never waits for
+/// the consumer. If the buffer is full, the data which does not fit is
+/// dropped and counted, so that the consumer can report the loss.
+///
+/// The consumer accesses the buffered data in place. Since the data may
+/// wrap around at the end of the internal array, it is provided as two
+/// contiguous spans (the second one may be empty). After processing, the
+/// consumer releases the data, making room for the producer.
+///
+/// Read and write positions are counters which are incremented
+/// monotonically. The capacity is rounded up to a power of two, so that
+/// the position in the array is obtained by a bit mask. Both counters are
+/// separated by padding to avoid false sharing of a cache line.
+///
+/// The function resize() is not thread-safe. It may only be called while
+/// neither producer nor consumer is active.
+///
+/// This class contains of a header file only. There is no corresponding
+/// implementation (cpp) file.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+class SPSCRingBuffer
+{
+public:
+    /// Contiguous range of data in the buffer
+    struct Span
+    {
+        const data_type *data;      ///< Pointer to the first element
+        std::size_t size;           ///< Number of elements
+    };
+
+    /// Buffered data in time order, given by two contiguous ranges
+    struct Spans
+    {
+        Span first;                 ///< Older part of the data
+        Span second;                ///< Newer part of the data (may be empty)
+        std::size_t size() const { return first.size + second.size; }
+    };
+
+    SPSCRingBuffer(std::size_t minimum_capacity = 0);  ///< Construct an empty buffer
+
+    void resize(std::size_t minimum_capacity);      ///< Reallocate and clear (not thread-safe)
+    std::size_t capacity() const { return mData.size(); }   ///< Actual capacity
+
+    // Producer
+    std::size_t write(const data_type *data, std::size_t n);    ///< Append data, drop if full
+
+    // Consumer
+    Spans read() const;                             ///< Access the buffered data in place
+    void release(std::size_t n);                    ///< Remove the oldest n elements
+    void discard();                                 ///< Remove all buffered data
+    std::size_t size() const;                       ///< Number of buffered elements
+    std::size_t takeDroppedCount();                 ///< Number of dropped elements since last call
+
+private:
+    static const std::size_t CACHE_LINE_SIZE = 64;  ///< Distance to avoid false sharing
+
+    std::vector<data_type> mData;                   ///< Internal cyclic data buffer
+    std::size_t mMask;                              ///< Capacity - 1 (capacity is a power of two)
+    char mPadding1[CACHE_LINE_SIZE];                ///< Separates the positions
+    std::atomic<std::size_t> mWritePosition;        ///< Written by the producer
+    std::atomic<std::size_t> mDroppedCount;         ///< Number of dropped elements (producer)
+    char mPadding2[CACHE_LINE_SIZE];                ///< Separates the positions
+    std::atomic<std::size_t> mReadPosition;         ///< Written by the consumer
+};
+
+//=============================================================================
+//    Ring buffer implementation (contained in header because of template)
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+//                              Constructor
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Constructor, creating an empty buffer.
+/// \param minimum_capacity : Minimal number of elements the buffer can hold.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+SPSCRingBuffer<data_type>::SPSCRingBuffer(std::size_t minimum_capacity)
+    : mData(),
+      mMask(0),
+      mPadding1(),
+      mWritePosition(0),
+      mDroppedCount(0),
+      mPadding2(),
+      mReadPosition(0)
+{
+    resize(minimum_capacity);
+}
+
+
+//-----------------------------------------------------------------------------
+//                            Resize the buffer
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Reallocate the buffer with a capacity given by the next power of two
+/// and clear its content. This function must not be called while the
+/// producer or the consumer is active.
+/// \param minimum_capacity : Minimal number of elements the buffer can hold.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+void SPSCRingBuffer<data_type>::resize(std::size_t minimum_capacity)
+{
+    std::size_t capacity = 1;
+    while (capacity < minimum_capacity) capacity *= 2;
+    mData.assign(minimum_capacity > 0 ? capacity : 0, data_type());
+    mMask = (mData.empty() ? 0 : capacity - 1);
+    mWritePosition.store(0);
+    mReadPosition.store(0);
+    mDroppedCount.store(0);
+}
+
+
+//-----------------------------------------------------------------------------
+//                      Append data (producer only)
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Append new data to the buffer. The data is copied by at most two
+/// memcpy operations. If the buffer is full, the remaining elements
+/// are dropped. This function never blocks.
+/// \param data : Pointer to the new data
+/// \param n : Number of elements
+/// \return Number of elements actually written
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+std::size_t SPSCRingBuffer<data_type>::write(const data_type *data, std::size_t n)
+{
+    const std::size_t w = mWritePosition.load(std::memory_order_relaxed);
+    const std::size_t r = mReadPosition.load(std::memory_order_acquire);
+    const std::size_t free = mData.size() - (w - r);
+    const std::size_t count = std::min(n, free);
+    if (count < n) mDroppedCount.fetch_add(n - count, std::memory_order_relaxed);
+    if (count == 0) return 0;
+
+    const std::size_t start = w & mMask;
+    const std::size_t part1Size = std::min(count, mData.size() - start);
+    std::memcpy(mData.data() + start, data, part1Size * sizeof(data_type));
+    std::memcpy(mData.data(), data + part1Size, (count - part1Size) * sizeof(data_type));
+
+    // publish the data
+    mWritePosition.store(w + count, std::memory_order_release);
+    return count;
+}
+
+
+//-----------------------------------------------------------------------------
+//                   Access the buffered data (consumer only)
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Access all data which is currently in the buffer without copying it.
+/// The data remains valid and unchanged until it is released.
+/// \return Two spans which together hold the buffered data in time order.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+typename SPSCRingBuffer<data_type>::Spans SPSCRingBuffer<data_type>::read() const
+{
+    const std::size_t r = mReadPosition.load(std::memory_order_relaxed);
+    const std::size_t w = mWritePosition.load(std::memory_order_acquire);
+    const std::size_t count = w - r;
+    const std::size_t start = r & mMask;
+    const std::size_t part1Size = std::min(count, mData.size() - start);
+    return {{mData.data() + start, part1Size},
+            {mData.data(), count - part1Size}};
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// Remove the oldest n elements from the buffer after they have been
+/// processed, allowing the producer to overwrite them.
+/// \param n : Number of elements to be removed
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+void SPSCRingBuffer<data_type>::release(std::size_t n)
+{
+    const std::size_t r = mReadPosition.load(std::memory_order_relaxed);
+    EptAssert(n <= mWritePosition.load(std::memory_order_acquire) - r,
+              "Do not release more data than existent.");
+    mReadPosition.store(r + n, std::memory_order_release);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// Remove all data which is currently in the buffer.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+void SPSCRingBuffer<data_type>::discard()
+{
+    mReadPosition.store(mWritePosition.load(std::memory_order_acquire),
+                        std::memory_order_release);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \return Number of elements currently in the buffer.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+std::size_t SPSCRingBuffer<data_type>::size() const
+{
+    const std::size_t r = mReadPosition.load(std::memory_order_relaxed);
+    return mWritePosition.load(std::memory_order_acquire) - r;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// Get the number of elements which were dropped by the producer because
+/// the buffer was full, and reset the counter.
+/// \return Number of dropped elements since the last call
+///////////////////////////////////////////////////////////////////////////////
+
+template <class data_type>
+std::size_t SPSCRingBuffer<data_type>::takeDroppedCount()
+{
+    return mDroppedCount.exchange(0, std::memory_order_relaxed);
+}
+
+#endif // SPSCRINGBUFFER_H
@@ -133,6 +133,7 @@ CORE_AUDIO_HEADERS = \
     audio/audiointerface.h \
     audio/circularbuffer.h \
     audio/pcmdevice.h \
+    audio/spscringbuffer.h \
     audio/player/hammerknock.h \
     audio/player/soundgenerator.h \
     audio/player/synthesizer.h \
@@ -160,18 +161,27 @@ CORE_MATH_HEADERS = \
     math/fftadapter.h \
     math/fftimplementation.h \
     math/mathtools.h \
+    math/simdtools.h \
+    math/decimator.h \
+    math/coarsegrainplan.h \
 
 CORE_MATH_SOURCES = \
     math/fftimplementation.cpp \
     math/mathtools.cpp \
+    math/simdtools.cpp \
+    math/decimator.cpp \
+    math/coarsegrainplan.cpp \
 
 #--------------- System --------------------
 
 CORE_SYSTEM_HEADERS = \
     system/log.h \
     system/simplethreadhandler.h \
+    system/persistentthreadhandler.h \
+    system/objectpool.h \
     system/eptexception.h \
     system/timer.h \
+    system/wakeupevent.h \
     system/version.h \
     system/platformtoolscore.h \
     system/serverinfo.h \
@@ -182,6 +192,7 @@ CORE_SYSTEM_SOURCES = \
     system/simplethreadhandler.cpp \
     system/eptexception.cpp \
     system/timer.cpp \
+    system/wakeupevent.cpp \
     system/platformtoolscore.cpp \
     system/serverinfo.cpp \
     system/basecallback.cpp \
@@ -200,12 +211,18 @@ CORE_ANALYZER_HEADERS = \
     analyzers/fftanalyzer.h \
     analyzers/fftanalyzererrorcodes.h \
     analyzers/overpull.h \
+    analyzers/spectrumaccumulator.h \
+    analyzers/kernelcache.h \
+    analyzers/windowstatistics.h \
 
 CORE_ANALYZER_SOURCES = \
     analyzers/signalanalyzer.cpp \
     analyzers/keyrecognizer.cpp \
     analyzers/fftanalyzer.cpp \
     analyzers/overpull.cpp \
+    analyzers/spectrumaccumulator.cpp \
+    analyzers/kernelcache.cpp \
+    analyzers/windowstatistics.cpp \
 
 #---------------- Piano --------------------
 
@@ -133,16 +133,14 @@ void FourierSpectrumGraphDrawer::updateSpectrum()
             double x = xposition(p.first);
 
             // Search for the corresponding peaks in the polygon:
-            auto pos1 = mPolygon->begin();
-            while (pos1!=mPolygon->end() and pos1->first < p.first*0.995) pos1++;
-            auto pos2 = pos1;
-            while (pos2!=mPolygon->end() and pos2->first < p.first*1.005) pos2++;
-            auto comp = [] (const std::pair<double,double> &a, const std::pair<double,double> &b)
-                { return a.second < b.second; };
-            auto maxelem = std::max_element(pos1,pos2, comp);
-            if (maxelem != mPolygon->end())
+            const std::vector<double> &intensities = mPolygon->intensities;
+            const size_t pos1 = mPolygon->lowerBound(p.first*0.995);
+            const size_t pos2 = std::max(pos1, mPolygon->lowerBound(p.first*1.005));
+            const size_t maxelem = std::distance(intensities.begin(),
+                    std::max_element(intensities.begin()+pos1, intensities.begin()+pos2));
+            if (maxelem < mPolygon->size())
             {
-                double y = 1-0.95*pow(maxelem->second, exponent);
+                double y = 1-0.95*pow(intensities[maxelem], exponent);
                 const double dx=0.003;
                 const double dy=0.02;
                 item = mGraphics->drawFilledRect(x-dx/2,y-dy/2,dx,dy,
@@ -159,10 +157,11 @@ void FourierSpectrumGraphDrawer::updateSpectrum()
     EptAssert(mConcertPitch > 0,"concert pitch should be positive");
     EptAssert(mNumberOfKeys > 0,"invalid number of keys");
 
-    for (auto &p : *mPolygon)
+    points.reserve(mPolygon->size());
+    for (size_t i=0; i<mPolygon->size(); ++i)
     {
-        double x=xposition(p.first);
-        if (x>=0 and x<=1) points.push_back({x, 1-0.95*pow(p.second,exponent)});
+        double x=xposition(mPolygon->frequencies[i]);
+        if (x>=0 and x<=1) points.push_back({x, 1-0.95*pow(mPolygon->intensities[i],exponent)});
     }
     item = mGraphics->drawChart(points, GraphicsViewAdapter::PEN_THIN_RED);
     if (item) item->setItemRole(ROLE_CHART);
@@ -67,7 +67,7 @@ private:
     int mNumberOfKeys;                      ///< Total number of keys
     int mSamplingRate;                      ///< copy of sample rate
     OperationMode mCurrentOperationMode;    ///< Current mode of operation
-    std::shared_ptr<FFTPolygon> mPolygon;   ///< Shared pointer to spectral polygon
+    std::shared_ptr<const FFTPolygon> mPolygon;   ///< Shared pointer to spectral polygon
     std::shared_ptr<Key> mKey;              ///< Shared pointer to selected key, holding the peaks
 };
 
@@ -0,0 +1,222 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                  Precomputed plan for coarse-graining a spectrum
+//=============================================================================
+
+#include "coarsegrainplan.h"
+
+#include <cmath>
+#include <mutex>
+#include <algorithm>
+
+#include "mathtools.h"
+#include "../system/eptexception.h"
+
+//-----------------------------------------------------------------------------
+//                              Constructor
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Constructor, computing the plan from the bin boundaries.
+///
+/// The component Y[y] collects the components of X between the real-valued
+/// boundaries xs[y] and xs[y+1], where each component X[x] covers the
+/// interval [x-1/2, x+1/2). Boundary components contribute with the
+/// fraction of their interval lying inside the bin. Components of Y
+/// which start beyond the end of X vanish.
+/// \param inputSize : Size of the vector X
+/// \param boundaries : Boundaries xs of the bins, one more than the size of Y
+/// \param exponent : The components are multiplied by (xs[y]*xs[y+1])^exponent
+///////////////////////////////////////////////////////////////////////////////
+
+CoarseGrainPlan::CoarseGrainPlan (size_t inputSize, const std::vector<double> &boundaries, double exponent) :
+    mInputSize(inputSize),
+    mOutputSize(boundaries.size() > 0 ? boundaries.size() - 1 : 0),
+    mValidSize(0),
+    mFirst(),
+    mLast(),
+    mLeftWeight(),
+    mRightWeight(),
+    mGain()
+{
+    EptAssert(inputSize > 0 and mOutputSize > 0, "Coarse-graining requires non-empty vectors");
+    const int N = static_cast<int>(inputSize);
+    const double xmax = N - 0.5;            // upper boundary of the last component of X
+    auto index = [N] (double xs)
+    { return std::max<int>(0, std::min<int>(MathTools::roundToInteger(xs), N - 1)); };
+
+    mFirst.reserve(mOutputSize);
+    mLast.reserve(mOutputSize);
+    mLeftWeight.reserve(mOutputSize);
+    mRightWeight.reserve(mOutputSize);
+    mGain.reserve(mOutputSize);
+
+    double xs1 = boundaries[0];
+    int x1 = index(xs1);
+    for (size_t y = 0; y < mOutputSize and xs1 < xmax; ++y)
+    {
+        const double xs2 = boundaries[y + 1];
+        const int x2 = index(xs2);
+        mFirst.push_back(x1);
+        mLast.push_back(x2);
+        mLeftWeight.push_back(x1 - std::min(xs1, xmax) + 0.5);
+        mRightWeight.push_back(x2 - std::min(xs2, xmax) + 0.5);
+        mGain.push_back(exponent == 0 ? 1.0 : std::pow(xs1 * xs2, exponent));
+        x1 = x2; xs1 = xs2;
+    }
+    mValidSize = mFirst.size();
+}
+
+
+//-----------------------------------------------------------------------------
+//                              Apply the plan
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Coarse-grain a vector.
+/// \param X : Input vector of the size given by getInputSize()
+/// \param Y : Output vector, resized to getOutputSize()
+///////////////////////////////////////////////////////////////////////////////
+
+void CoarseGrainPlan::apply (const std::vector<double> &X, std::vector<double> &Y) const
+{
+    Y.resize(mOutputSize);
+    apply(X, Y.data(), 0, mOutputSize);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Coarse-grain a vector, computing only a range of components.
+/// \param X : Input vector of the size given by getInputSize()
+/// \param Y : Pointer to the output, Y[0] receives the component begin
+/// \param begin : First component to be computed
+/// \param end : Component after the last one to be computed
+///////////////////////////////////////////////////////////////////////////////
+
+void CoarseGrainPlan::apply (const std::vector<double> &X, double *Y, size_t begin, size_t end) const
+{
+    EptAssert(X.size() == mInputSize, "Size of the input does not match the plan");
+    EptAssert(begin <= end and end <= mOutputSize, "Invalid range of the output");
+    const double *x = X.data();
+    const size_t valid = std::min(end, std::max(begin, mValidSize));
+    for (size_t y = begin; y < valid; ++y)
+    {
+        const int first = mFirst[y], last = mLast[y];
+        double sum = 0;
+        for (int k = first + 1; k <= last; ++k) sum += x[k];
+        Y[y - begin] = (sum + mLeftWeight[y] * x[first] - mRightWeight[y] * x[last]) * mGain[y];
+    }
+    std::fill(Y + (valid - begin), Y + (end - begin), 0);
+}
+
+
+//-----------------------------------------------------------------------------
+//                     Boundaries of a functional mapping
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the bin boundaries xs[y] = f(y-1/2) of a mapping x=f(y).
+/// \param outputSize : Size of the vector Y
+/// \param f : Function mapping indices of Y to indices of X
+/// \return Vector of outputSize+1 boundaries
+///////////////////////////////////////////////////////////////////////////////
+
+std::vector<double> CoarseGrainPlan::computeBoundaries (size_t outputSize, const Mapping &f)
+{
+    std::vector<double> boundaries(outputSize + 1);
+    for (size_t y = 0; y <= outputSize; ++y) boundaries[y] = f(y - 0.5);
+    return boundaries;
+}
+
+
+//-----------------------------------------------------------------------------
+//                           Cache of the plans
+//-----------------------------------------------------------------------------
+
+namespace
+{
+    /// Entry of the global cache of plans
+    struct CachedPlan
+    {
+        std::string mapping;                ///< Name of the mapping
+        size_t inputSize;                   ///< Size of the input vector
+        int samplingRate;                   ///< Sampling rate of the input
+        double exponent;                    ///< Exponent of the gain factor
+        CoarseGrainPlan::Pointer plan;      ///< The plan
+    };
+
+    std::mutex cacheMutex;                  ///< Mutex protecting the cache
+    std::vector<CachedPlan> cache;          ///< Global cache of the plans
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Find a plan in the global cache.
+///
+/// This function is thread-safe and does not allocate any memory.
+/// \param mapping : Unique name of the mapping
+/// \param inputSize : Size of the vector X
+/// \param samplingRate : Sampling rate of the spectrum X
+/// \param exponent : Exponent of the gain factor
+/// \return Shared pointer to the plan, empty if not cached
+///////////////////////////////////////////////////////////////////////////////
+
+CoarseGrainPlan::Pointer CoarseGrainPlan::find (const char *mapping, size_t inputSize,
+                                                int samplingRate, double exponent)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for (const CachedPlan &entry : cache)
+    {
+        if (entry.inputSize == inputSize and entry.samplingRate == samplingRate
+                and entry.exponent == exponent and entry.mapping == mapping)
+            return entry.plan;
+    }
+    return Pointer();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Create a plan and insert it into the global cache.
+///
+/// If the cache exceeds MAXIMAL_NUMBER_OF_PLANS it is cleared, plans in use
+/// remain valid. If another thread inserted the same plan in the meantime,
+/// that plan is returned. This function is thread-safe.
+/// \param mapping : Unique name of the mapping
+/// \param inputSize : Size of the vector X
+/// \param samplingRate : Sampling rate of the spectrum X
+/// \param exponent : Exponent of the gain factor
+/// \param boundaries : Bin boundaries
+/// \return Shared pointer to the plan
+///////////////////////////////////////////////////////////////////////////////
+
+CoarseGrainPlan::Pointer CoarseGrainPlan::insert (const char *mapping, size_t inputSize,
+                                                  int samplingRate, double exponent,
+                                                  const std::vector<double> &boundaries)
+{
+    Pointer plan = std::make_shared<CoarseGrainPlan>(inputSize, boundaries, exponent);
+    Pointer existing = find(mapping, inputSize, samplingRate, exponent);
+    if (existing) return existing;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (cache.size() >= MAXIMAL_NUMBER_OF_PLANS) cache.clear();
+    cache.push_back({mapping, inputSize, samplingRate, exponent, plan});
+    return plan;
+}
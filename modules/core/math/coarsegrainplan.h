@@ -0,0 +1,104 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                  Precomputed plan for coarse-graining a spectrum
+//=============================================================================
+
+#ifndef COARSEGRAINPLAN_H
+#define COARSEGRAINPLAN_H
+
+#include <vector>
+#include <functional>
+
+#include "prerequisites.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Precomputed plan for coarse-graining a spectrum
+///
+/// Several modules map the linear power spectrum X[x] to a nonlinearly
+/// binned spectrum Y[y] (see MathTools::coarseGrainSpectrum). The
+/// boundaries of the bins only depend on the size of X, the sampling rate
+/// and the mapping, which is expensive to evaluate (powers and
+/// exponentials for each bin). The plan stores for each component of Y
+/// the index range in X, the fractional weights of the boundary
+/// components and the gain factor. Applying the plan is then a simple
+/// loop of sums over contiguous ranges.
+///
+/// Plans are shared by means of a global cache, see CoarseGrainPlan::get.
+///////////////////////////////////////////////////////////////////////////////
+
+class EPT_EXTERN CoarseGrainPlan
+{
+public:
+    using Pointer = std::shared_ptr<const CoarseGrainPlan>;    ///< Shared plan
+    using Mapping = std::function<double(double y)>;            ///< Map x=f(y)
+
+    static const size_t MAXIMAL_NUMBER_OF_PLANS = 32;           ///< Size limit of the cache
+
+    CoarseGrainPlan (size_t inputSize, const std::vector<double> &boundaries, double exponent = 0);
+
+    size_t getInputSize() const { return mInputSize; }          ///< Required size of X
+    size_t getOutputSize() const { return mOutputSize; }        ///< Size of Y
+
+    void apply (const std::vector<double> &X, std::vector<double> &Y) const;
+    void apply (const std::vector<double> &X, double *Y, size_t begin, size_t end) const;
+
+    static std::vector<double> computeBoundaries (size_t outputSize, const Mapping &f);
+
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Get a shared plan from the global cache, creating it if needed
+    ///
+    /// A plan is identified by the name of the mapping, the size of the
+    /// input vector, the sampling rate and the exponent. The caller has to
+    /// make sure that the boundaries are completely determined by these
+    /// quantities. The boundaries are only computed if the plan is not yet
+    /// cached. Looking up a cached plan does not allocate any memory.
+    /// \param mapping : Unique name of the mapping
+    /// \param inputSize : Size of the vector X
+    /// \param samplingRate : Sampling rate of the spectrum X
+    /// \param exponent : Exponent of the gain factor
+    /// \param boundaries : Function returning the bin boundaries
+    /// \return Shared pointer to the plan
+    ///////////////////////////////////////////////////////////////////////////
+    template <class Function>
+    static Pointer get (const char *mapping, size_t inputSize, int samplingRate,
+                        double exponent, Function boundaries)
+    {
+        Pointer plan = find(mapping, inputSize, samplingRate, exponent);
+        if (plan) return plan;
+        return insert(mapping, inputSize, samplingRate, exponent, boundaries());
+    }
+
+    static Pointer find (const char *mapping, size_t inputSize, int samplingRate, double exponent);
+    static Pointer insert (const char *mapping, size_t inputSize, int samplingRate, double exponent,
+                           const std::vector<double> &boundaries);
+
+private:
+    size_t mInputSize;                      ///< Size of the input vector X
+    size_t mOutputSize;                     ///< Size of the output vector Y
+    size_t mValidSize;                      ///< Components of Y inside the range of X
+    std::vector<int> mFirst;                ///< First index in X of each component
+    std::vector<int> mLast;                 ///< Last index in X of each component
+    std::vector<double> mLeftWeight;        ///< Weight of X[first]
+    std::vector<double> mRightWeight;       ///< Weight subtracted from X[last]
+    std::vector<double> mGain;              ///< Gain factor of each component
+};
+
+#endif // COARSEGRAINPLAN_H
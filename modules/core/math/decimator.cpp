@@ -0,0 +1,198 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                         Streaming decimation filter
+//=============================================================================
+
+#include "decimator.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "mathtools.h"
+#include "../system/eptexception.h"
+
+const double Decimator::PASSBAND = 0.9;
+
+//-----------------------------------------------------------------------------
+//                              Constructor
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Constructor, creating a decimator with factor 1 (no decimation).
+///////////////////////////////////////////////////////////////////////////////
+
+Decimator::Decimator() :
+    mFactor(1),
+    mCoefficients(),
+    mBuffer(),
+    mPhase(0)
+{
+    setFactor(1);
+}
+
+
+//-----------------------------------------------------------------------------
+//                      Design the filter for a factor
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Set the decimation factor and design the anti-aliasing filter.
+///
+/// The cutoff of the low-pass filter is placed at the new Nyquist
+/// frequency. With the Blackman window the transition band extends
+/// over +-10% of the new Nyquist frequency, so that aliased components
+/// do not reach the passband. The state of the filter is reset.
+/// \param factor : Decimation factor between 1 and MAXIMAL_FACTOR
+///////////////////////////////////////////////////////////////////////////////
+
+void Decimator::setFactor (int factor)
+{
+    EptAssert(factor >= 1 and factor <= MAXIMAL_FACTOR, "Invalid decimation factor");
+    mFactor = factor;
+    if (factor == 1)
+    {
+        mCoefficients.assign(1, 1.0);
+    }
+    else
+    {
+        const int L = factor * TAPS_PER_PHASE;
+        const double cutoff = 0.5 / factor;             // in units of the input sampling rate
+        const double middle = 0.5 * (L - 1);
+        mCoefficients.resize(L);
+        double sum = 0;
+        for (int k = 0; k < L; ++k)
+        {
+            const double t = k - middle;
+            const double x = MathTools::TWO_PI * cutoff * t;
+            const double sinc = (t == 0 ? 1.0 : std::sin(x) / x);
+            const double phi = MathTools::TWO_PI * k / (L - 1);
+            const double window = 0.42 - 0.5 * std::cos(phi) + 0.08 * std::cos(2 * phi);
+            mCoefficients[k] = sinc * window;
+            sum += mCoefficients[k];
+        }
+        for (auto &c : mCoefficients) c /= sum;         // unit gain at zero frequency
+    }
+    reset();
+}
+
+
+//-----------------------------------------------------------------------------
+//                          Clear the filter state
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Clear the history of the filter, as if the signal started with
+/// zeros.
+///////////////////////////////////////////////////////////////////////////////
+
+void Decimator::reset ()
+{
+    mBuffer.assign(mCoefficients.size() - 1, 0);
+    mPhase = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Preallocate the buffer of the filter.
+///
+/// Afterwards process() does not allocate memory as long as the packets
+/// do not exceed the given size and the output vector has sufficient
+/// capacity.
+/// \param n : Maximal number of samples per call of process()
+///////////////////////////////////////////////////////////////////////////////
+
+void Decimator::reserve (size_t n)
+{
+    mBuffer.reserve(mCoefficients.size() - 1 + n);
+}
+
+
+//-----------------------------------------------------------------------------
+//                          Decimate new samples
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Filter and decimate newly arrived samples.
+///
+/// The new samples are appended to the history of the filter. For each
+/// output sample the filter is applied to a contiguous section of the
+/// buffer, which allows the compiler to vectorize the inner loop.
+/// \param in : Pointer to the new samples
+/// \param n : Number of new samples
+/// \param out : Vector receiving the decimated samples (overwritten)
+///////////////////////////////////////////////////////////////////////////////
+
+void Decimator::process (const FFTRealType *in, size_t n, FFTRealVector &out)
+{
+    out.clear();
+    if (n == 0) return;
+    if (mFactor == 1)
+    {
+        out.assign(in, in + n);
+        return;
+    }
+
+    const size_t L = mCoefficients.size();
+    const size_t history = L - 1;
+    mBuffer.insert(mBuffer.end(), in, in + n);
+
+    // the output at position p of the new samples needs the inputs p-L+1...p
+    const FFTRealType *h = mCoefficients.data();
+    out.reserve(n / mFactor + 1);
+    size_t p = mPhase;
+    for (; p < n; p += mFactor)
+    {
+        const FFTRealType *x = mBuffer.data() + p;
+        double y = 0;
+        for (size_t k = 0; k < L; ++k) y += h[k] * x[k];
+        out.push_back(y);
+    }
+    mPhase = p - n;
+
+    // keep the history for the next call
+    mBuffer.erase(mBuffer.begin(), mBuffer.begin() + (mBuffer.size() - history));
+}
+
+
+//-----------------------------------------------------------------------------
+//                  Select the factor for a given bandwidth
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Select the largest power-of-two decimation factor which
+/// preserves a given bandwidth.
+///
+/// The reduced sampling rate is passed on as an integer (see FFTData).
+/// Only factors dividing the sampling rate exactly are therefore admitted,
+/// otherwise all frequencies would be biased by the truncation (e.g.
+/// 44100/8 = 5512 instead of 5512.5 Hz).
+/// \param samplingRate : Sampling rate of the input signal
+/// \param bandwidth : Highest frequency in Hz which has to be preserved
+/// \return Decimation factor between 1 and MAXIMAL_FACTOR
+///////////////////////////////////////////////////////////////////////////////
+
+int Decimator::selectFactor (int samplingRate, double bandwidth)
+{
+    int factor = MAXIMAL_FACTOR;
+    while (factor > 1 and (samplingRate % factor != 0 or
+                           PASSBAND * samplingRate / (2.0 * factor) < bandwidth)) factor /= 2;
+    return factor;
+}
@@ -0,0 +1,73 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                         Streaming decimation filter
+//=============================================================================
+
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include "prerequisites.h"
+#include "fftadapter.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Streaming decimator with an anti-aliasing low-pass filter
+///
+/// The decimator reduces the sampling rate of a signal by an integer factor
+/// D. Before dropping samples, the signal is filtered by a windowed-sinc
+/// low-pass filter (Blackman window) with D*TAPS_PER_PHASE coefficients.
+/// The filter is evaluated in its polyphase form, i.e., only every D-th
+/// output sample is computed, so that the cost per input sample is
+/// TAPS_PER_PHASE multiply-adds independent of the factor.
+///
+/// Frequencies up to the fraction PASSBAND of the new Nyquist frequency
+/// are preserved. Components in the transition band may alias, but only
+/// into the range above the passband. The state of the filter is carried
+/// from one call to the next, so that a signal can be decimated packet
+/// by packet as it arrives.
+///////////////////////////////////////////////////////////////////////////////
+
+class EPT_EXTERN Decimator
+{
+public:
+    static const int MAXIMAL_FACTOR = 8;        ///< Largest supported decimation factor
+    static const int TAPS_PER_PHASE = 64;       ///< Filter length per output sample
+    static const double PASSBAND;               ///< Preserved fraction of the new Nyquist frequency
+
+    Decimator();
+    ~Decimator() {}
+
+    void setFactor (int factor);                            // Design the filter for a factor
+    int getFactor() const { return mFactor; }               ///< Current decimation factor
+    void reset ();                                          // Clear the state of the filter
+    void reserve (size_t n);                                // Preallocate for packets of n samples
+
+    void process (const FFTRealType *in, size_t n, FFTRealVector &out);
+
+    static int selectFactor (int samplingRate, double bandwidth);
+
+private:
+    int mFactor;                                ///< Decimation factor D
+    FFTRealVector mCoefficients;                ///< Coefficients of the low-pass filter
+    FFTRealVector mBuffer;                      ///< Filter history followed by the new samples
+    size_t mPhase;                              ///< Position of the next output in the new samples
+};
+
+#endif // DECIMATOR_H
@@ -24,7 +24,10 @@
 #ifndef FFTADAPTER
 #define FFTADAPTER
 
+#include <algorithm>
+
 #include "prerequisites.h"
+#include "../system/objectpool.h"
 
 // Data types to be processed by the FFT software
 using FFTRealType      = double;
@@ -38,8 +41,145 @@ using FFTComplexVector = std::vector<FFTComplexType>;
 using FFTWType      = FFTRealType;
 /// fftw array
 using FFTWVector = std::vector<FFTWType>;
-/// Type for a frequency-to-intensity map for graphics
-typedef std::map<double,double> FFTPolygon;
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Polygon of a spectrum for graphics
+///
+/// The polygon relates frequencies to intensities. The points are stored
+/// as two contiguous arrays sorted by increasing frequency, so that
+/// points can be located by binary search.
+///////////////////////////////////////////////////////////////////////////////
+struct EPT_EXTERN FFTPolygon
+{
+    std::vector<double> frequencies;    ///< Frequencies in increasing order
+    std::vector<double> intensities;    ///< Corresponding intensities
+
+    size_t size() const { return frequencies.size(); }     ///< Number of points
+    bool empty() const { return frequencies.empty(); }      ///< True if there are no points
+
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Index of the first point with a frequency not below f
+    /// \param f : Frequency in Hz
+    /// \return Index of the point, size() if there is none
+    ///////////////////////////////////////////////////////////////////////////
+    size_t lowerBound (double f) const
+    {
+        return static_cast<size_t>(std::lower_bound(frequencies.begin(), frequencies.end(), f)
+                                   - frequencies.begin());
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Policy for the length of a Fourier transform
+///
+/// FFTW is considerably slower if the transformation size contains large
+/// prime factors. The signal can therefore be zero-padded or trimmed to
+/// a nearby length of the form 2^a 3^b 5^c 7^d.
+///////////////////////////////////////////////////////////////////////////////
+enum class FFTSizePolicy
+{
+    EXACT,              ///< Transform the signal with its actual length
+    ZERO_PAD,           ///< Pad the signal with zeros to the next smooth length
+    TRIM,               ///< Drop the oldest samples down to the previous smooth length
+};
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Thread-safe cache for products derived from a Fourier transform
+///
+/// Several modules process the same Fourier transform in different threads,
+/// e.g. the SignalAnalyzer creates a polygon for drawing while the
+/// KeyRecognizer and the FFTAnalyzer map it to logarithmically binned
+/// spectra. Such derived products are stored here under a unique name.
+/// A product is computed lazily by the first module requesting it, all
+/// other modules receive a shared pointer to the same constant object.
+/// Different products can be computed in parallel, while concurrent
+/// requests of the same product wait for its first computation.
+///
+/// Copies of the cache are empty, since the products belong to the data
+/// they were computed from. Products can be recycled by an ObjectPool.
+///////////////////////////////////////////////////////////////////////////////
+class EPT_EXTERN FFTProductCache
+{
+public:
+    FFTProductCache() {}
+    FFTProductCache (const FFTProductCache &) {}
+    FFTProductCache &operator= (const FFTProductCache &) { clear(); return *this; }
+
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Get a derived product, computing it if not yet available
+    /// \param name : Unique name of the product, its type is always Product
+    /// \param compute : Function filling a default-constructed Product
+    /// \return Shared pointer to the product
+    ///////////////////////////////////////////////////////////////////////////
+    template <class Product, class Function>
+    std::shared_ptr<const Product> get (const char *name, Function compute)
+    {
+        return getOrCreate<Product>(name, compute, [] () { return std::make_shared<Product>(); });
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Get a derived product, taking the storage from a pool
+    ///
+    /// The product is recycled from the pool if available. The function
+    /// computing the product must therefore overwrite its complete state.
+    /// \param name : Unique name of the product, its type is always Product
+    /// \param compute : Function filling a recycled Product
+    /// \param pool : Pool providing the storage of the product
+    /// \return Shared pointer to the product
+    ///////////////////////////////////////////////////////////////////////////
+    template <class Product, class Function>
+    std::shared_ptr<const Product> get (const char *name, Function compute, ObjectPool<Product> &pool)
+    {
+        return getOrCreate<Product>(name, compute, [&pool] () { return pool.acquire(); });
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Remove all products, required if the data is modified
+    ///
+    /// The slots of the products are kept, so that a recycled FFTData
+    /// does not allocate them again.
+    ///////////////////////////////////////////////////////////////////////////
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto &entry : mSlots)
+        {
+            std::lock_guard<std::mutex> slotLock(entry.second->mutex);
+            entry.second->product.reset();
+        }
+    }
+
+private:
+    /// Storage of a single product
+    struct Slot
+    {
+        std::mutex mutex;                           ///< Locked during the computation
+        std::shared_ptr<const void> product;        ///< The product, empty if not yet computed
+    };
+
+    /// Get a product whose storage is provided by the function create
+    template <class Product, class Function, class Create>
+    std::shared_ptr<const Product> getOrCreate (const char *name, Function &compute, Create create)
+    {
+        std::shared_ptr<Slot> slot;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mSlots.find(name);
+            if (it == mSlots.end()) it = mSlots.emplace(name, std::make_shared<Slot>()).first;
+            slot = it->second;
+        }
+        std::lock_guard<std::mutex> lock(slot->mutex);
+        if (not slot->product)
+        {
+            std::shared_ptr<Product> product = create();
+            compute(*product);
+            slot->product = std::move(product);
+        }
+        return std::static_pointer_cast<const Product>(slot->product);
+    }
+
+    std::mutex mMutex;                              ///< Mutex protecting the map
+    std::map<std::string, std::shared_ptr<Slot>, std::less<>> mSlots; ///< Products by name
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Data struct for a FFT
@@ -48,10 +188,16 @@ typedef std::map<double,double> FFTPolygon;
 /// The first argument its the FFTPointer the second one the sampling rate.
 /// Invalid or unset states have a invalid FFTPointer or a negative sampling
 /// rate.
+///
+/// Products derived from the data, such as logarithmically binned spectra,
+/// are cached in the member products. Once a product has been requested
+/// the data must not be modified any more (or the cache has to be cleared).
 ///////////////////////////////////////////////////////////////////////////////
 struct EPT_EXTERN FFTData {
     FFTWVector fft;         ///< The actual fft
     int samplingRate = -1;  ///< The sampling rate of the fft
+    int signalLength = -1;  ///< Number of samples without zero-padding, negative if not padded
+    mutable FFTProductCache products;   ///< Lazily computed products derived from the fft
 
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief Function to validate the fft data.
@@ -66,10 +212,12 @@ struct EPT_EXTERN FFTData {
 
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief Function to get the time of the signal in seconds
-    /// \return 2 * fft.size() / samplingRate
+    /// \return 2 * fft.size() / samplingRate, or the length of the signal
+    /// before zero-padding divided by the sampling rate
     ///
     ///////////////////////////////////////////////////////////////////////////////
     double getTime() {
+        if (signalLength > 0) return static_cast<double>(signalLength) / samplingRate;
         return fft.size() * 2.0 / samplingRate;
     }
 };
@@ -93,6 +241,11 @@ template class EPT_EXTERN std::shared_ptr<FFTData>;
 ///
 /// The adapter is designed for two types of FFTs, namely, real to complex
 /// and comples to real. The second one is the inverse of the first one.
+///
+/// Apart from the vector-based functions, the adapter provides an interface
+/// operating on raw arrays. getInputBuffer() and execute() allow the caller
+/// to write the signal directly into the memory of the implementation, so
+/// that no data has to be copied.
 ///////////////////////////////////////////////////////////////////////////////
 
 class EPT_EXTERN FFTAdapter
@@ -105,6 +258,18 @@ public:
     virtual void calculateFFT  (const FFTRealVector &in, FFTComplexVector &out) = 0;
     virtual void calculateFFT  (const FFTComplexVector &in, FFTRealVector &out) = 0;
 
+    // Array-based transformations of size N (real size)
+    virtual void calculateFFT  (const FFTRealType *in, FFTComplexType *out, size_t N) = 0;
+    virtual void calculateFFT  (const FFTComplexType *in, FFTRealType *out, size_t N) = 0;
+
+    // Fused transformation real -> power spectrum of size N/2+1
+    virtual void calculatePowerSpectrum (const FFTRealVector &in, FFTRealVector &powerspectrum) = 0;
+    virtual void calculatePowerSpectrum (const FFTRealType *in, FFTRealType *powerspectrum, size_t N) = 0;
+
+    // Zero-copy transformation: write N samples to the buffer, then execute
+    virtual FFTRealType *getInputBuffer (size_t N) = 0;
+    virtual const FFTComplexType *execute () = 0;
+
     // Call these functions to speed up FFT with the same size
     virtual void optimize (FFTRealVector &in) = 0;
     virtual void optimize (FFTComplexVector &in) = 0;
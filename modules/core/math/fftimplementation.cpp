@@ -23,18 +23,27 @@
 
 #include "fftimplementation.h"
 
+#include <algorithm>
 #include <cstring>
+#include <iterator>
 #include <iostream>
 #include <typeinfo>
 
 #include "../system/eptexception.h"
 #include "../system/log.h"
+#include "simdtools.h"
 
 //-----------------------------------------------------------------------------
-//                              static mutex
+//                     static mutex and plan cache
 //-----------------------------------------------------------------------------
 
-std::mutex FFT_Implementation::mPlanMutex;
+// The mutex is needed when the plans in the cache are destroyed at the end
+// of the program. Since std::mutex is initialized at compile time it is
+// available regardless of the order of initialization.
+template <typename T>
+std::mutex FFTWImplementation<T>::mPlanMutex;
+template <typename T>
+std::list<typename FFTWImplementation<T>::CachedPlan> FFTWImplementation<T>::mPlanCache;
 
 
 //-----------------------------------------------------------------------------
@@ -45,15 +54,22 @@ std::mutex FFT_Implementation::mPlanMutex;
 /// \brief Constructor, clears member variables and checks type consistency
 ///////////////////////////////////////////////////////////////////////////////
 
-FFT_Implementation::FFT_Implementation() :
+template <typename T>
+FFTWImplementation<T>::FFTWImplementation() :
     mRvec1(nullptr),
     mRvec2(nullptr),
     mCvec1(nullptr),
     mCvec2(nullptr),
     mNRC(0),
     mNCR(0),
-    mPlanRC(nullptr),
-    mPlanCR(nullptr)
+    mCapacityRC(0),
+    mCapacityCR(0),
+    mRigorRC(0),
+    mRigorCR(0),
+    mInputStage(),
+    mOutputStage(),
+    mPlanRC(),
+    mPlanCR()
 {
     // Check the consistency of types defined in the adapater:
     EptAssert (typeid(FFTRealType)==typeid(double),
@@ -68,22 +84,79 @@ FFT_Implementation::FFT_Implementation() :
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Destructor, deletes plans and local vector copies if existing.
+/// \brief Destructor, deletes the local vector copies if existing.
+///
+/// The plans are owned by the plan cache and destroyed automatically
+/// when they are no longer used.
 ///////////////////////////////////////////////////////////////////////////////
 
-FFT_Implementation::~FFT_Implementation()
+template <typename T>
+FFTWImplementation<T>::~FFTWImplementation()
 {
-    std::lock_guard<std::mutex> lock(mPlanMutex);
     try
     {
-        if (mPlanRC) fftw_destroy_plan(mPlanRC);
-        if (mPlanCR) fftw_destroy_plan(mPlanCR);
-        if (mRvec1) free(mRvec1);
-        if (mCvec2) fftw_free(mCvec2);
-        if (mCvec1) fftw_free(mCvec1);
-        if (mRvec2) free(mRvec2);
+        if (mRvec1) Traits::freeMemory(mRvec1);
+        if (mCvec2) Traits::freeMemory(mCvec2);
+        if (mCvec1) Traits::freeMemory(mCvec1);
+        if (mRvec2) Traits::freeMemory(mRvec2);
     }
-    catch (...) LogE("fftw3_destroy_plan throwed an exception");
+    catch (...) LogE("fftw_free throwed an exception");
+}
+
+
+//-----------------------------------------------------------------------------
+//                         Import and export wisdom
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Import the accumulated wisdom of the FFTW planner from a file.
+///
+/// Plans whose optimization is recorded in the wisdom can be created
+/// immediately, even if a high planning rigor such as FFTW_PATIENT is
+/// requested.
+/// \param filename : Absolute path of the wisdom file
+/// \return true on success, false if the file could not be read
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+bool FFTWImplementation<T>::importWisdom (const std::string &filename)
+{
+    if (filename.empty()) return false;
+    std::lock_guard<std::mutex> lock(mPlanMutex);
+    bool success = false;
+    try {
+        success = (Traits::importWisdom(filename.c_str()) != 0);
+    }
+    catch (...) LogE("fftw_import_wisdom_from_filename throwed an exception");
+    if (success) {
+        LogI("FFTW wisdom imported from %s", filename.c_str());
+    } else {
+        LogI("No FFTW wisdom found in %s", filename.c_str());
+    }
+    return success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Export the accumulated wisdom of the FFTW planner to a file.
+/// \param filename : Absolute path of the wisdom file
+/// \return true on success, false if the file could not be written
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+bool FFTWImplementation<T>::exportWisdom (const std::string &filename)
+{
+    if (filename.empty()) return false;
+    std::lock_guard<std::mutex> lock(mPlanMutex);
+    bool success = false;
+    try {
+        success = (Traits::exportWisdom(filename.c_str()) != 0);
+    }
+    catch (...) LogE("fftw_export_wisdom_to_filename throwed an exception");
+    if (not success) {
+        LogW("Could not export FFTW wisdom to %s", filename.c_str());
+    }
+    return success;
 }
 
 
@@ -102,9 +175,10 @@ FFT_Implementation::~FFT_Implementation()
 /// \param in : vector of real numbers to be transformed
 ///////////////////////////////////////////////////////////////////////////////
 
-void FFT_Implementation::optimize (FFTRealVector &in)
+template <typename T>
+void FFTWImplementation<T>::optimize (FFTRealVector &in)
 {
-    updatePlan(in,FFTW_PATIENT);
+    updatePlanRC(in.size(),FFTW_PATIENT);
 }
 
 
@@ -123,9 +197,11 @@ void FFT_Implementation::optimize (FFTRealVector &in)
 /// \param in : vector of complex numbers to be transformed
 ///////////////////////////////////////////////////////////////////////////////
 
-void FFT_Implementation::optimize (FFTComplexVector &in)
+template <typename T>
+void FFTWImplementation<T>::optimize (FFTComplexVector &in)
 {
-    updatePlan(in,FFTW_MEASURE);
+    EptAssert(in.size()>1,"vector size has to be larger than one");
+    updatePlanCR(2*in.size()-2,FFTW_MEASURE);
 }
 
 
@@ -134,39 +210,42 @@ void FFT_Implementation::optimize (FFTComplexVector &in)
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Construct a new plan for the FFT transformation if necessary.
+/// \brief Provide a plan for the FFT transformation if necessary.
 ///
-/// This function checks whether the plan and the local vectors still
-/// exist and whether they have the correct size. If so, the function does
-/// nothing which means that the existing plan will be reused. Ohterwise,
-/// it deletes the plan and the vectors and constructs them again
-/// with the given size.
+/// This function checks whether the plan still exists with the correct size
+/// and a sufficient planning rigor. If so, the function does nothing which
+/// means that the existing plan will be reused. Ohterwise, the plan is taken
+/// from the plan cache. The local vectors are only reallocated if they
+/// are too small.
 ///
-/// \param in : vector of real numbers of size N
+/// \param N : size of the real vector
 /// \param flags : fftw3 internal flags controlling planmaking
 ///////////////////////////////////////////////////////////////////////////////
 
-void FFT_Implementation::updatePlan (const FFTRealVector &in,
-                                     unsigned flags)
+template <typename T>
+void FFTWImplementation<T>::updatePlanRC (size_t N, unsigned flags)
 {
     // if plan still exists and input vector has the same size do nothing
-    if (mPlanRC and mRvec1 and mCvec2 and in.size()==mNRC) return
-    EptAssert(in.size()>0,"vector size has to be nonzero");
+    if (mPlanRC and N==mNRC and mRigorRC >= getRigor(flags)) return;
+    EptAssert(N>0,"vector size has to be nonzero");
 
-    std::lock_guard<std::mutex> lock(mPlanMutex);
     try {
-        // delete old plan and vectors
-        if (mPlanRC) fftw_destroy_plan(mPlanRC);
-        if (mRvec1) free(mRvec1);
-        if (mCvec2) fftw_free(mCvec2);
-
-        // allocate new vectors and create a new plan
-        mNRC   = in.size();
-        mRvec1 = static_cast<double *>(malloc(mNRC*sizeof(double)));
-        mCvec2 = static_cast<fftw_complex*>(fftw_malloc((mNRC/2+1)*sizeof(fftw_complex)));
-        EptAssert(mRvec1, "May not be nullptr");
-        EptAssert(mCvec2, "May not be nullptr");
-        mPlanRC = fftw_plan_dft_r2c_1d (static_cast<int>(mNRC), mRvec1, mCvec2, flags);
+        // enlarge the local vectors if necessary
+        if (N > mCapacityRC)
+        {
+            if (mRvec1) Traits::freeMemory(mRvec1);
+            if (mCvec2) Traits::freeMemory(mCvec2);
+            mCapacityRC = N;
+            mRvec1 = Traits::allocReal(mCapacityRC);
+            mCvec2 = Traits::allocComplex(mCapacityRC/2+1);
+            EptAssert(mRvec1, "May not be nullptr");
+            EptAssert(mCvec2, "May not be nullptr");
+        }
+
+        // get the plan from the cache
+        mNRC    = N;
+        mRigorRC = getRigor(flags);
+        mPlanRC = getPlan(mNRC, Direction::REAL_TO_COMPLEX, flags);
     }
     catch (...) LogE("fftw_pplan_dft_r2c_1d throwed an exception");
 }
@@ -177,44 +256,137 @@ void FFT_Implementation::updatePlan (const FFTRealVector &in,
 //-----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-/// \brief Construct a new plan for the FFT transformation if necessary.
+/// \brief Provide a plan for the FFT transformation if necessary.
 ///
-/// This function checks whether the plan and the local vectors still
-/// exist and whether they have the correct size. If so, the function does
-/// nothing which means that the existing plan will be reused. Ohterwise,
-/// it deletes the plan and the vectors and constructs them again
-/// with the given size.
+/// This function checks whether the plan still exists with the correct size
+/// and a sufficient planning rigor. If so, the function does nothing which
+/// means that the existing plan will be reused. Ohterwise, the plan is taken
+/// from the plan cache. The local vectors are only reallocated if they
+/// are too small.
 ///
-/// \param in : vector of complex numbers
+/// \param N : size of the real vector (the complex vector has size N/2+1)
 /// \param flags : fftw3 internal flags controlling planmaking
 ///////////////////////////////////////////////////////////////////////////////
 
-void FFT_Implementation::updatePlan (const FFTComplexVector &in,
-                                     unsigned flags)
+template <typename T>
+void FFTWImplementation<T>::updatePlanCR (size_t N, unsigned flags)
 {
-    // if plan still exists and input vector has the same size do nothing
-    if (mPlanCR and mCvec1 and mRvec2 and in.size()==mNCR/2+1) return;
-    EptAssert(in.size()>0,"vector size has to be nonzero");
+    // if plan still exists and output vector has the same size do nothing
+    if (mPlanCR and N==mNCR and mRigorCR >= getRigor(flags)) return;
+    EptAssert(N>0,"vector size has to be nonzero");
 
-    std::lock_guard<std::mutex> lock(mPlanMutex);
     try {
-        // delete old plan and vectors
-        if (mPlanCR) fftw_destroy_plan(mPlanCR);
-        if (mCvec1) fftw_free(mCvec1);
-        if (mRvec2) free(mRvec2);
-
-        // allocate new vectors and create a new plan
-        mNCR   = 2*in.size()-2;
-        mCvec1 = static_cast<fftw_complex*>(fftw_malloc((mNCR/2+1)*sizeof(fftw_complex)));
-        mRvec2 = static_cast<double *>(malloc(mNCR*sizeof(double)));
-        EptAssert(mCvec1, "May not be nullptr");
-        EptAssert(mRvec2, "May not be nullptr");
-        mPlanCR = fftw_plan_dft_c2r_1d (static_cast<int>(mNCR), mCvec1, mRvec2, flags);
+        // enlarge the local vectors if necessary
+        if (N > mCapacityCR)
+        {
+            if (mCvec1) Traits::freeMemory(mCvec1);
+            if (mRvec2) Traits::freeMemory(mRvec2);
+            mCapacityCR = N;
+            mCvec1 = Traits::allocComplex(mCapacityCR/2+1);
+            mRvec2 = Traits::allocReal(mCapacityCR);
+            EptAssert(mCvec1, "May not be nullptr");
+            EptAssert(mRvec2, "May not be nullptr");
+        }
+
+        // get the plan from the cache
+        mNCR    = N;
+        mRigorCR = getRigor(flags);
+        mPlanCR = getPlan(mNCR, Direction::COMPLEX_TO_REAL, flags);
     }
     catch (...) LogE("fftw_pplan_dft_c2r_1d throwed an exception");
 }
 
 
+//-----------------------------------------------------------------------------
+//               Private function: get a plan from the cache
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get a plan from the process-wide plan cache.
+///
+/// If the cache holds a plan with the requested size and direction which
+/// was made with at least the requested rigor, this plan is returned and
+/// marked as recently used. Otherwise a new plan is created on temporary
+/// vectors and stored in the cache. If the cache is full, the least
+/// recently used plan is removed from the cache. It will be destroyed as
+/// soon as no instance uses it any longer.
+///
+/// \param size : Size N of the real vector
+/// \param direction : Direction of the transformation
+/// \param flags : fftw3 internal flags controlling planmaking
+/// \return Shared pointer to the plan, nullptr if planning failed
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+typename FFTWImplementation<T>::PlanPointer FFTWImplementation<T>::getPlan (size_t size,
+                                                                          Direction direction,
+                                                                          unsigned flags)
+{
+    // Plans removed from the cache have to be released after unlocking
+    // the mutex since the deleter locks it as well
+    std::list<CachedPlan> removedPlans;
+    PlanPointer plan;
+
+    std::lock_guard<std::mutex> lock(mPlanMutex);
+    const int rigor = getRigor(flags);
+    for (auto it = mPlanCache.begin(); it != mPlanCache.end(); ++it)
+    {
+        if (it->size == size and it->direction == direction and it->rigor >= rigor)
+        {
+            // move to the front (most recently used)
+            mPlanCache.splice(mPlanCache.begin(), mPlanCache, it);
+            return mPlanCache.front().plan;
+        }
+    }
+
+    // create a new plan on temporary vectors of the same alignment
+    RealType *rvec = Traits::allocReal(size);
+    ComplexType *cvec = Traits::allocComplex(size/2+1);
+    EptAssert(rvec and cvec, "May not be nullptr");
+    PlanType p = (direction == Direction::REAL_TO_COMPLEX ?
+                      Traits::planR2C (static_cast<int>(size), rvec, cvec, flags) :
+                      Traits::planC2R (static_cast<int>(size), cvec, rvec, flags));
+    Traits::freeMemory(rvec);
+    Traits::freeMemory(cvec);
+    if (not p)
+    {
+        LogE("Could not create a plan for an FFT of size %d", static_cast<int>(size));
+        return plan;
+    }
+    plan.reset(p, [](PlanType p) {
+        std::lock_guard<std::mutex> lock(mPlanMutex);
+        Traits::destroyPlan(p);
+    });
+
+    // insert as the most recently used plan and remove the oldest ones
+    mPlanCache.push_front({size, direction, rigor, plan});
+    while (mPlanCache.size() > PLAN_CACHE_SIZE)
+        removedPlans.splice(removedPlans.begin(), mPlanCache, std::prev(mPlanCache.end()));
+    return plan;
+}
+
+
+//-----------------------------------------------------------------------------
+//             Private function: rank of the planning rigor
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Rank of the planning rigor encoded in the flags.
+/// \param flags : fftw3 internal flags controlling planmaking
+/// \return 0 for FFTW_ESTIMATE, 1 for FFTW_MEASURE, 2 for FFTW_PATIENT,
+/// and 3 for FFTW_EXHAUSTIVE.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+int FFTWImplementation<T>::getRigor (unsigned flags)
+{
+    if (flags & FFTW_EXHAUSTIVE) return 3;
+    if (flags & FFTW_PATIENT) return 2;
+    if (flags & FFTW_ESTIMATE) return 0;
+    return 1;
+}
+
+
 //-----------------------------------------------------------------------------
 //                   Calculate forward FFT real -> complex
 //-----------------------------------------------------------------------------
@@ -227,7 +399,8 @@ void FFT_Implementation::updatePlan (const FFTComplexVector &in,
 /// \param out : vector of complex numbers, will be resized to N/2+1
 ///////////////////////////////////////////////////////////////////////////////
 
-void FFT_Implementation::calculateFFT  (const FFTRealVector &in, FFTComplexVector &out)
+template <typename T>
+void FFTWImplementation<T>::calculateFFT  (const FFTRealVector &in, FFTComplexVector &out)
 {
     // resize output vector
     if (out.size() != in.size()/2+1) out.resize(in.size()/2+1);
@@ -238,13 +411,38 @@ void FFT_Implementation::calculateFFT  (const FFTRealVector &in, FFTComplexVecto
         return;
     }
 
-    // Perform the computation
-    updatePlan(in,FFTW_ESTIMATE);
-    EptAssert (in.size()==mNRC and out.size()==mNRC/2+1,"Vector consistency");
+    calculateFFT(in.data(), out.data(), in.size());
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Foward FFT on arrays provided by the caller.
+///
+/// If the arrays have the same alignment as the arrays for which the
+/// plan was made (e.g. if they were allocated by the FFTAlignedAllocator)
+/// the transformation is carried out directly on these arrays. Otherwise
+/// the data is copied into the local vectors. In single precision the
+/// data is always converted.
+///
+/// \param in : array of N real numbers
+/// \param out : array of N/2+1 complex numbers
+/// \param N : size of the transformation
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+void FFTWImplementation<T>::calculateFFT (const FFTRealType *in, FFTComplexType *out, size_t N)
+{
+    EptAssert (in and out and N>0, "Invalid arrays");
+    updatePlanRC(N,FFTW_ESTIMATE);
+    EptAssert (mPlanRC, "No plan available");
     try {
-        std::memcpy(mRvec1,in.data(),mNRC*sizeof(double));
-        fftw_execute(mPlanRC);
-        std::memcpy(out.data(), static_cast<const void*>(mCvec2),(mNRC/2+1)*sizeof(fftw_complex));
+        ComplexType *cout = reinterpret_cast<ComplexType*>(out);
+        const bool alignedOut = NATIVE and
+                (Traits::alignmentOf(reinterpret_cast<RealType*>(cout)) ==
+                 Traits::alignmentOf(reinterpret_cast<RealType*>(mCvec2)));
+        Traits::executeR2C(mPlanRC.get(), importRealInput(in,N), alignedOut ? cout : mCvec2);
+        if (not alignedOut)
+            for (size_t k=0; k<N/2+1; ++k) out[k] = FFTComplexType(mCvec2[k][0], mCvec2[k][1]);
     }
     catch (...) LogE("fftw_execute throwed an exception");
 }
@@ -262,16 +460,184 @@ void FFT_Implementation::calculateFFT  (const FFTRealVector &in, FFTComplexVecto
 /// \param out : vector of real numbers, will be resized to size 2*M-1
 ///////////////////////////////////////////////////////////////////////////////
 
-void FFT_Implementation::calculateFFT  (const FFTComplexVector &in, FFTRealVector &out)
+template <typename T>
+void FFTWImplementation<T>::calculateFFT  (const FFTComplexVector &in, FFTRealVector &out)
 {
-    EptAssert (in.size()>=1,"calling FFT with empty vector");
+    EptAssert (in.size()>1,"calling FFT with empty vector");
     if (out.size() != 2*in.size()-2) out.resize(2*in.size()-2);
-    updatePlan(in,FFTW_ESTIMATE);
-    EptAssert (in.size()==mNCR/2+1 and out.size()==mNCR,"Vector consistency");
+    calculateFFT(in.data(), out.data(), out.size());
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Backward FFT on arrays provided by the caller.
+///
+/// Since a complex-to-real transformation destroys its input, the input
+/// is always copied into the local vector. In double precision the output
+/// is written directly into the array of the caller if it has the same
+/// alignment as the array for which the plan was made.
+///
+/// \param in : array of N/2+1 complex numbers
+/// \param out : array of N real numbers
+/// \param N : size of the transformation
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+void FFTWImplementation<T>::calculateFFT (const FFTComplexType *in, FFTRealType *out, size_t N)
+{
+    EptAssert (in and out and N>0, "Invalid arrays");
+    updatePlanCR(N,FFTW_ESTIMATE);
+    EptAssert (mPlanCR, "No plan available");
     try {
-        std::memcpy(mCvec1,in.data(),(mNCR/2+1)*sizeof(fftw_complex));
-        fftw_execute(mPlanCR);
-        std::memcpy(out.data(),mRvec2,mNCR*sizeof(double));
+        RealType *rout = reinterpret_cast<RealType*>(out);
+        const bool alignedOut = NATIVE and
+                (Traits::alignmentOf(rout) == Traits::alignmentOf(mRvec2));
+        for (size_t k=0; k<N/2+1; ++k)
+        {
+            mCvec1[k][0] = static_cast<RealType>(in[k].real());
+            mCvec1[k][1] = static_cast<RealType>(in[k].imag());
+        }
+        Traits::executeC2R(mPlanCR.get(), mCvec1, alignedOut ? rout : mRvec2);
+        if (not alignedOut) std::copy(mRvec2, mRvec2+N, out);
     }
     catch (...) LogE("fftw_execute throwed an exception");
 }
+
+
+//-----------------------------------------------------------------------------
+//                 Fused computation of the power spectrum
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the power spectrum |FFT|^2 of a real vector.
+///
+/// The output vector is only resized if its size differs from N/2+1,
+/// so that a vector reused in subsequent calls is not reallocated.
+/// \param in : vector of real numbers of size N
+/// \param powerspectrum : vector of size N/2+1 receiving the intensities
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+void FFTWImplementation<T>::calculatePowerSpectrum (const FFTRealVector &in, FFTRealVector &powerspectrum)
+{
+    if (powerspectrum.size() != in.size()/2+1) powerspectrum.resize(in.size()/2+1);
+    if (in.size() == 0) {
+        LogD("Calling FFT with empty vector. Skipping computation");
+        return;
+    }
+    calculatePowerSpectrum(in.data(), powerspectrum.data(), in.size());
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the power spectrum |FFT|^2 of a real array.
+///
+/// The Fourier transform is computed in the local output vector and
+/// converted into intensities by a vectorized kernel (SimdTools) in a
+/// single pass, without creating an intermediate complex vector. In single
+/// precision the kernel converts the result back to double precision.
+/// \param in : array of N real numbers
+/// \param powerspectrum : array of N/2+1 real numbers receiving the intensities
+/// \param N : size of the transformation
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+void FFTWImplementation<T>::calculatePowerSpectrum (const FFTRealType *in, FFTRealType *powerspectrum, size_t N)
+{
+    EptAssert (in and powerspectrum and N>0, "Invalid arrays");
+    updatePlanRC(N,FFTW_ESTIMATE);
+    EptAssert (mPlanRC, "No plan available");
+    try {
+        Traits::executeR2C(mPlanRC.get(), importRealInput(in,N), mCvec2);
+    }
+    catch (...) LogE("fftw_execute throwed an exception");
+    SimdTools::computePowerSpectrum(reinterpret_cast<const std::complex<RealType>*>(mCvec2),
+                                    powerspectrum, N/2+1);
+}
+
+
+//-----------------------------------------------------------------------------
+//              Zero-copy transformation of the local vectors
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the local input vector for a forward FFT of size N.
+///
+/// The caller writes the signal directly into the returned array and
+/// calls execute() afterwards, avoiding any copies. The array remains valid
+/// until the next call with a different size. In single precision the
+/// returned array is a staging buffer which is converted by execute().
+/// \param N : size of the transformation
+/// \return Aligned array of N real numbers
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+FFTRealType *FFTWImplementation<T>::getInputBuffer (size_t N)
+{
+    updatePlanRC(N,FFTW_ESTIMATE);
+    if (NATIVE) return reinterpret_cast<FFTRealType*>(mRvec1);
+    if (mInputStage.size() < N) mInputStage.resize(N);
+    return mInputStage.data();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Forward FFT of the local input vector.
+///
+/// The data has to be written to the array returned by getInputBuffer()
+/// before.
+/// \return Array of N/2+1 complex numbers holding the Fourier transform,
+/// valid until the next transformation.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+const FFTComplexType *FFTWImplementation<T>::execute ()
+{
+    EptAssert (mPlanRC and mRvec1 and mCvec2, "Input buffer has to be requested first");
+    if (not NATIVE) std::copy(mInputStage.begin(), mInputStage.begin()+mNRC, mRvec1);
+    try {
+        Traits::executeR2C(mPlanRC.get(), mRvec1, mCvec2);
+    }
+    catch (...) LogE("fftw_execute throwed an exception");
+    if (NATIVE) return reinterpret_cast<const FFTComplexType*>(mCvec2);
+
+    mOutputStage.resize(mNRC/2+1);
+    for (size_t k=0; k<mNRC/2+1; ++k) mOutputStage[k] = FFTComplexType(mCvec2[k][0], mCvec2[k][1]);
+    return mOutputStage.data();
+}
+
+
+//-----------------------------------------------------------------------------
+//            Private function: provide the input of a forward FFT
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Provide the input array for a forward FFT of size N.
+///
+/// An out-of-place r2c transform preserves its input. Therefore, in double
+/// precision the array of the caller is used directly if it has the same
+/// alignment as the local vector for which the plan was made. Otherwise the
+/// data is copied into the local vector, converting it to the internal type.
+/// \param in : array of N real numbers
+/// \param N : size of the transformation
+/// \return Array to be passed to the plan
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+typename FFTWImplementation<T>::RealType *FFTWImplementation<T>::importRealInput (const FFTRealType *in, size_t N)
+{
+    RealType *rin = reinterpret_cast<RealType*>(const_cast<FFTRealType*>(in));
+    if (NATIVE and Traits::alignmentOf(rin) == Traits::alignmentOf(mRvec1)) return rin;
+    std::copy(in, in+N, mRvec1);
+    return mRvec1;
+}
+
+
+//-----------------------------------------------------------------------------
+//                           Explicit instances
+//-----------------------------------------------------------------------------
+
+template class EPT_EXTERN FFTWImplementation<double>;
+#ifdef EPT_FFTW3F
+template class EPT_EXTERN FFTWImplementation<float>;
+#endif
@@ -22,6 +22,7 @@
 //=============================================================================
 
 #include "mathtools.h"
+#include "coarsegrainplan.h"
 
 #include <algorithm>
 #include <numeric>
@@ -140,12 +141,16 @@ void MathTools::normalize (std::vector<double> &vec)
 /// Therefore, the map is suitable for mapping probability distributions.
 /// If the function f maps indices in the range of Y to a subset of the
 /// index range of X, i.e., if it does not read all of X, the
-/// corresponding probability is lost.
+/// corresponding probability is lost. Components of Y which are mapped
+/// beyond the end of X are set to zero.
 ///
 /// \param X : Given vector of floating point values (probabilities)
 /// \param Y : Target vector of a given size.
 /// \param f : Function used for coarse-graining
 /// \param exponent : exponent used for the mapping
+///
+/// If the same map is applied repeatedly, a CoarseGrainPlan should be
+/// used directly, which avoids evaluating the function f on each call.
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -155,19 +160,8 @@ void MathTools::coarseGrainSpectrum (const std::vector<double> &X,
                                      double exponent)
 {
     assert(X.size()>0 and Y.size()>0);
-    double xs1 = f(-0.5);
-    int x1 = std::max<int>(0, roundToInteger(xs1));
-    double leftarea = (x1-xs1+0.5)*X[x1];
-    for (int y=0; y<static_cast<int>(Y.size()); ++y)
-    {
-        double xs2 = f(y+0.5);
-        int x2 = std::min<int>(roundToInteger(xs2), static_cast<int>(X.size()) - 1);
-        double sum=0;
-        for (int x=x1+1; x<=x2; ++x) sum += X[x];
-        double rightarea = (x2-xs2+0.5)*X[x2];
-        Y[y] = (sum + leftarea - rightarea) * pow(xs1*xs2,exponent);
-        x1=x2; xs1=xs2; leftarea=rightarea;
-    }
+    CoarseGrainPlan plan(X.size(), CoarseGrainPlan::computeBoundaries(Y.size(), f), exponent);
+    plan.apply(X, Y);
 }
 
 //-----------------------------------------------------------------------------
@@ -230,3 +224,49 @@ double MathTools::restrictToInterval(double x, double xmin, double xmax)
     EptAssert(xmax > xmin, "xmax should be larger than xmin");
     return std::max(xmin, std::min(xmax, x));
 }
+
+
+//-----------------------------------------------------------------------------
+//	             Numbers without prime factors larger than 7
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Check whether a number is of the form 2^a 3^b 5^c 7^d.
+///
+/// FFTW is particularly fast for transformation sizes of this form
+/// while large prime factors slow down the computation considerably.
+/// \param n : Number to be checked
+/// \return true if n has no prime factors larger than 7
+///////////////////////////////////////////////////////////////////////////////
+
+bool MathTools::isSmoothNumber (size_t n)
+{
+    if (n == 0) return false;
+    for (size_t p : {2, 3, 5, 7}) while (n % p == 0) n /= p;
+    return n == 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the smallest number >= n of the form 2^a 3^b 5^c 7^d.
+/// \param n : Lower bound
+/// \return Smallest smooth number which is not smaller than n
+///////////////////////////////////////////////////////////////////////////////
+
+size_t MathTools::nextSmoothNumber (size_t n)
+{
+    if (n <= 1) return 1;
+    while (not isSmoothNumber(n)) ++n;
+    return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the largest number <= n of the form 2^a 3^b 5^c 7^d.
+/// \param n : Upper bound
+/// \return Largest smooth number which is not larger than n, 0 if n=0
+///////////////////////////////////////////////////////////////////////////////
+
+size_t MathTools::previousSmoothNumber (size_t n)
+{
+    while (n > 0 and not isSmoothNumber(n)) --n;
+    return n;
+}
@@ -78,6 +78,15 @@ EPT_EXTERN double weightedArithmetricMean(const std::vector<double> &Y, size_t s
 /// Restrict floating point value to an interval
 EPT_EXTERN double restrictToInterval (double x, double xmin, double xmax);
 
+/// Check whether a number has no prime factors larger than 7
+EPT_EXTERN bool isSmoothNumber (size_t n);
+
+/// Smallest number >= n without prime factors larger than 7
+EPT_EXTERN size_t nextSmoothNumber (size_t n);
+
+/// Largest number <= n without prime factors larger than 7
+EPT_EXTERN size_t previousSmoothNumber (size_t n);
+
 /// Map a vector to a different one by a unary map
 template <typename T>
 void transformVector (const std::vector<T> &v, std::vector<T> &w,
@@ -0,0 +1,397 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                    Vectorized kernels for spectral data
+//=============================================================================
+
+#include "simdtools.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#   define EPT_SIMD_X86 1
+#   include <immintrin.h>
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#   endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#   define EPT_SIMD_NEON 1
+#   include <arm_neon.h>
+#endif
+
+// Functions using instructions which are not enabled globally have to be
+// marked for the compiler (gcc, clang). MSVC accepts all intrinsics anyway.
+#if defined(__GNUC__) || defined(__clang__)
+#   define EPT_SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#   define EPT_SIMD_TARGET(isa)
+#endif
+
+namespace {
+
+using PowerSpectrumKernel = void (*)(const std::complex<double> *, double *, size_t);
+using PowerSpectrumKernelFloat = void (*)(const std::complex<float> *, double *, size_t);
+using MultiplyConjugateKernel = void (*)(const std::complex<double> *, const std::complex<double> *,
+                                         std::complex<double> *, size_t, double);
+
+//-----------------------------------------------------------------------------
+//                     Plain C++ implementation (fallback)
+//-----------------------------------------------------------------------------
+
+void computePowerSpectrumScalar (const std::complex<double> *in, double *out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = in[i].real() * in[i].real() + in[i].imag() * in[i].imag();
+}
+
+void computePowerSpectrumFloatScalar (const std::complex<float> *in, double *out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        const double re = in[i].real(), im = in[i].imag();
+        out[i] = re * re + im * im;
+    }
+}
+
+void multiplyConjugateScalar (const std::complex<double> *a, const std::complex<double> *b,
+                              std::complex<double> *out, size_t n, double factor)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        const double ar = a[i].real(), ai = a[i].imag();
+        const double br = b[i].real(), bi = b[i].imag();
+        out[i] = std::complex<double>(factor * (ar * br + ai * bi), factor * (ai * br - ar * bi));
+    }
+}
+
+#if EPT_SIMD_X86
+
+//-----------------------------------------------------------------------------
+//                            SSE2 implementation
+//-----------------------------------------------------------------------------
+
+EPT_SIMD_TARGET("sse2")
+void computePowerSpectrumSSE2 (const std::complex<double> *in, double *out, size_t n)
+{
+    const double *p = reinterpret_cast<const double *>(in);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128d a = _mm_loadu_pd(p + 2 * i);            // re0 im0
+        __m128d b = _mm_loadu_pd(p + 2 * i + 2);        // re1 im1
+        a = _mm_mul_pd(a, a);
+        b = _mm_mul_pd(b, b);
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b)));
+    }
+    computePowerSpectrumScalar(in + i, out + i, n - i);
+}
+
+EPT_SIMD_TARGET("sse2")
+void computePowerSpectrumFloatSSE2 (const std::complex<float> *in, double *out, size_t n)
+{
+    const float *p = reinterpret_cast<const float *>(in);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128 c = _mm_loadu_ps(p + 2 * i);      // re0 im0 re1 im1
+        __m128d a = _mm_cvtps_pd(c);                    // re0 im0
+        __m128d b = _mm_cvtps_pd(_mm_movehl_ps(c, c));  // re1 im1
+        a = _mm_mul_pd(a, a);
+        b = _mm_mul_pd(b, b);
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b)));
+    }
+    computePowerSpectrumFloatScalar(in + i, out + i, n - i);
+}
+
+EPT_SIMD_TARGET("sse2")
+void multiplyConjugateSSE2 (const std::complex<double> *a, const std::complex<double> *b,
+                            std::complex<double> *out, size_t n, double factor)
+{
+    const double *pa = reinterpret_cast<const double *>(a);
+    const double *pb = reinterpret_cast<const double *>(b);
+    double *po = reinterpret_cast<double *>(out);
+    const __m128d sign = _mm_set_pd(-0.0, 0.0);         // negates the imaginary part
+    const __m128d f = _mm_set1_pd(factor);
+    for (size_t i = 0; i < n; ++i)
+    {
+        const __m128d x = _mm_loadu_pd(pa + 2 * i);     // ar ai
+        const __m128d y = _mm_loadu_pd(pb + 2 * i);     // br bi
+        const __m128d t1 = _mm_mul_pd(x, _mm_unpacklo_pd(y, y));                // ar*br ai*br
+        const __m128d t2 = _mm_mul_pd(_mm_shuffle_pd(x, x, 1), _mm_unpackhi_pd(y, y)); // ai*bi ar*bi
+        _mm_storeu_pd(po + 2 * i, _mm_mul_pd(f, _mm_add_pd(t1, _mm_xor_pd(t2, sign))));
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+EPT_SIMD_TARGET("avx2")
+void computePowerSpectrumAVX2 (const std::complex<double> *in, double *out, size_t n)
+{
+    const double *p = reinterpret_cast<const double *>(in);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d a = _mm256_loadu_pd(p + 2 * i);         // re0 im0 re1 im1
+        __m256d b = _mm256_loadu_pd(p + 2 * i + 4);     // re2 im2 re3 im3
+        a = _mm256_mul_pd(a, a);
+        b = _mm256_mul_pd(b, b);
+        const __m256d sum = _mm256_hadd_pd(a, b);       // |c0| |c2| |c1| |c3|
+        _mm256_storeu_pd(out + i, _mm256_permute4x64_pd(sum, 0xD8));
+    }
+    computePowerSpectrumScalar(in + i, out + i, n - i);
+}
+
+EPT_SIMD_TARGET("avx2")
+void computePowerSpectrumFloatAVX2 (const std::complex<float> *in, double *out, size_t n)
+{
+    const float *p = reinterpret_cast<const float *>(in);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m256 c = _mm256_loadu_ps(p + 2 * i);    // re0 im0 ... re3 im3
+        __m256d a = _mm256_cvtps_pd(_mm256_castps256_ps128(c));     // re0 im0 re1 im1
+        __m256d b = _mm256_cvtps_pd(_mm256_extractf128_ps(c, 1));   // re2 im2 re3 im3
+        a = _mm256_mul_pd(a, a);
+        b = _mm256_mul_pd(b, b);
+        const __m256d sum = _mm256_hadd_pd(a, b);       // |c0| |c2| |c1| |c3|
+        _mm256_storeu_pd(out + i, _mm256_permute4x64_pd(sum, 0xD8));
+    }
+    computePowerSpectrumFloatScalar(in + i, out + i, n - i);
+}
+
+EPT_SIMD_TARGET("avx2")
+void multiplyConjugateAVX2 (const std::complex<double> *a, const std::complex<double> *b,
+                            std::complex<double> *out, size_t n, double factor)
+{
+    const double *pa = reinterpret_cast<const double *>(a);
+    const double *pb = reinterpret_cast<const double *>(b);
+    double *po = reinterpret_cast<double *>(out);
+    const __m256d sign = _mm256_set_pd(-0.0, 0.0, -0.0, 0.0);   // negates the imaginary parts
+    const __m256d f = _mm256_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m256d x = _mm256_loadu_pd(pa + 2 * i);  // ar0 ai0 ar1 ai1
+        const __m256d y = _mm256_loadu_pd(pb + 2 * i);  // br0 bi0 br1 bi1
+        const __m256d t1 = _mm256_mul_pd(x, _mm256_movedup_pd(y));                      // ar*br ai*br
+        const __m256d t2 = _mm256_mul_pd(_mm256_permute_pd(x, 0x5), _mm256_permute_pd(y, 0xF)); // ai*bi ar*bi
+        _mm256_storeu_pd(po + 2 * i, _mm256_mul_pd(f, _mm256_add_pd(t1, _mm256_xor_pd(t2, sign))));
+    }
+    multiplyConjugateScalar(a + i, b + i, out + i, n - i, factor);
+}
+
+//-----------------------------------------------------------------------------
+
+bool cpuSupportsSSE2 ()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;                                        // part of the x86-64 baseline
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool cpuSupportsAVX2 ()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (not osxsave or not avx) return false;
+    if ((_xgetbv(0) & 6) != 6) return false;            // OS saves the ymm registers
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // EPT_SIMD_X86
+
+#if EPT_SIMD_NEON
+
+//-----------------------------------------------------------------------------
+//                            NEON implementation
+//-----------------------------------------------------------------------------
+
+void computePowerSpectrumNEON (const std::complex<double> *in, double *out, size_t n)
+{
+    const double *p = reinterpret_cast<const double *>(in);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        const float64x2x2_t c = vld2q_f64(p + 2 * i);   // deinterleave re and im
+        float64x2_t r = vmulq_f64(c.val[0], c.val[0]);
+        r = vfmaq_f64(r, c.val[1], c.val[1]);
+        vst1q_f64(out + i, r);
+    }
+    computePowerSpectrumScalar(in + i, out + i, n - i);
+}
+
+void computePowerSpectrumFloatNEON (const std::complex<float> *in, double *out, size_t n)
+{
+    const float *p = reinterpret_cast<const float *>(in);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const float32x4x2_t c = vld2q_f32(p + 2 * i);   // deinterleave re and im
+        const float64x2_t re0 = vcvt_f64_f32(vget_low_f32(c.val[0]));
+        const float64x2_t im0 = vcvt_f64_f32(vget_low_f32(c.val[1]));
+        const float64x2_t re1 = vcvt_high_f64_f32(c.val[0]);
+        const float64x2_t im1 = vcvt_high_f64_f32(c.val[1]);
+        vst1q_f64(out + i,     vfmaq_f64(vmulq_f64(re0, re0), im0, im0));
+        vst1q_f64(out + i + 2, vfmaq_f64(vmulq_f64(re1, re1), im1, im1));
+    }
+    computePowerSpectrumFloatScalar(in + i, out + i, n - i);
+}
+
+void multiplyConjugateNEON (const std::complex<double> *a, const std::complex<double> *b,
+                            std::complex<double> *out, size_t n, double factor)
+{
+    const double *pa = reinterpret_cast<const double *>(a);
+    const double *pb = reinterpret_cast<const double *>(b);
+    double *po = reinterpret_cast<double *>(out);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        const float64x2x2_t x = vld2q_f64(pa + 2 * i);  // deinterleave re and im
+        const float64x2x2_t y = vld2q_f64(pb + 2 * i);
+        float64x2x2_t r;
+        r.val[0] = vmulq_n_f64(vfmaq_f64(vmulq_f64(x.val[0], y.val[0]), x.val[1], y.val[1]), factor);
+        r.val[1] = vmulq_n_f64(vfmsq_f64(vmulq_f64(x.val[1], y.val[0]), x.val[0], y.val[1]), factor);
+        vst2q_f64(po + 2 * i, r);
+    }
+    multiplyConjugateScalar(a + i, b + i, out + i, n - i, factor);
+}
+
+#endif // EPT_SIMD_NEON
+
+
+//-----------------------------------------------------------------------------
+//                            Runtime dispatch
+//-----------------------------------------------------------------------------
+
+/// Kernels selected for the present CPU
+struct Kernels
+{
+    PowerSpectrumKernel powerSpectrum;
+    PowerSpectrumKernelFloat powerSpectrumFloat;
+    MultiplyConjugateKernel multiplyConjugate;
+    const char *instructionSet;
+};
+
+Kernels selectKernels ()
+{
+#if EPT_SIMD_X86
+    if (cpuSupportsAVX2()) return {computePowerSpectrumAVX2, computePowerSpectrumFloatAVX2,
+                                   multiplyConjugateAVX2, "AVX2"};
+    if (cpuSupportsSSE2()) return {computePowerSpectrumSSE2, computePowerSpectrumFloatSSE2,
+                                   multiplyConjugateSSE2, "SSE2"};
+#elif EPT_SIMD_NEON
+    return {computePowerSpectrumNEON, computePowerSpectrumFloatNEON,
+            multiplyConjugateNEON, "NEON"};
+#endif
+    return {computePowerSpectrumScalar, computePowerSpectrumFloatScalar,
+            multiplyConjugateScalar, "none"};
+}
+
+const Kernels &getKernels ()
+{
+    // initialized once in a thread-safe manner
+    static const Kernels kernels = selectKernels();
+    return kernels;
+}
+
+} // anonymous namespace
+
+
+//-----------------------------------------------------------------------------
+//                          Public interface
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the squared magnitudes of complex numbers.
+///
+/// This is the inner loop converting a Fourier transform into a power
+/// spectrum. Input and output arrays do not need a particular alignment.
+/// \param in : Array of n complex numbers
+/// \param out : Array of n real numbers receiving |in[i]|^2
+/// \param n : Number of elements
+///////////////////////////////////////////////////////////////////////////////
+
+void SimdTools::computePowerSpectrum (const std::complex<double> *in, double *out, size_t n)
+{
+    getKernels().powerSpectrum(in, out, n);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the squared magnitudes of single-precision complex numbers.
+///
+/// The components are converted to double precision before squaring,
+/// so that the result can be used in place of the double-precision one.
+/// \param in : Array of n complex numbers
+/// \param out : Array of n real numbers receiving |in[i]|^2
+/// \param n : Number of elements
+///////////////////////////////////////////////////////////////////////////////
+
+void SimdTools::computePowerSpectrum (const std::complex<float> *in, double *out, size_t n)
+{
+    getKernels().powerSpectrumFloat(in, out, n);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Multiply complex numbers by the complex conjugate of others.
+///
+/// This is the inner loop of a cross-correlation computed in Fourier space.
+/// The real factor allows the normalization of the backward transform to
+/// be included in the same pass. The output may coincide with one of the
+/// input arrays.
+/// \param a : Array of n complex numbers
+/// \param b : Array of n complex numbers which are conjugated
+/// \param out : Array of n complex numbers receiving factor * a[i] * conj(b[i])
+/// \param n : Number of elements
+/// \param factor : Real factor applied to all products
+///////////////////////////////////////////////////////////////////////////////
+
+void SimdTools::multiplyConjugate (const std::complex<double> *a, const std::complex<double> *b,
+                                   std::complex<double> *out, size_t n, double factor)
+{
+    getKernels().multiplyConjugate(a, b, out, n, factor);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Name of the instruction set selected at runtime.
+/// \return "AVX2", "SSE2", "NEON" or "none"
+///////////////////////////////////////////////////////////////////////////////
+
+const char *SimdTools::getInstructionSet ()
+{
+    return getKernels().instructionSet;
+}
@@ -0,0 +1,58 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                    Vectorized kernels for spectral data
+//=============================================================================
+
+#ifndef SIMDTOOLS_H
+#define SIMDTOOLS_H
+
+#include <complex>
+
+#include "prerequisites.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Vectorized kernels for the inner loops of the spectral analysis
+///
+/// The functions in this namespace are implemented for several instruction
+/// sets (AVX2, SSE2, NEON and plain C++). On x86 processors the fastest
+/// instruction set supported by the CPU is selected at runtime when a
+/// kernel is called for the first time. On ARM processors NEON is selected
+/// at compile time if available.
+///////////////////////////////////////////////////////////////////////////////
+
+namespace SimdTools {
+
+/// Compute the squared magnitudes |c|^2 of n complex numbers
+EPT_EXTERN void computePowerSpectrum (const std::complex<double> *in, double *out, size_t n);
+
+/// Compute the squared magnitudes |c|^2 of n single-precision complex numbers
+EPT_EXTERN void computePowerSpectrum (const std::complex<float> *in, double *out, size_t n);
+
+/// Multiply n complex numbers by the complex conjugate of others and a real factor
+EPT_EXTERN void multiplyConjugate (const std::complex<double> *a, const std::complex<double> *b,
+                                   std::complex<double> *out, size_t n, double factor = 1);
+
+/// Name of the instruction set selected at runtime
+EPT_EXTERN const char *getInstructionSet ();
+
+} // SimdTools
+
+#endif // SIMDTOOLS_H
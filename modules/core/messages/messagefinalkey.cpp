@@ -19,8 +19,25 @@
 
 #include "messagefinalkey.h"
 
+MessageFinalKey::MessageFinalKey() :
+    Message(MSG_FINAL_KEY),
+    mKey(), mKeyNumber(-1)
+{
+}
+
 MessageFinalKey::MessageFinalKey(int keyNumber, std::shared_ptr<Key> key) :
     Message(MSG_FINAL_KEY),
     mKey(key), mKeyNumber(keyNumber)
 {
 }
+
+void MessageFinalKey::setData(int keyNumber, std::shared_ptr<Key> key)
+{
+    mKey = key;
+    mKeyNumber = keyNumber;
+}
+
+void MessageFinalKey::releaseData()
+{
+    mKey.reset();
+}
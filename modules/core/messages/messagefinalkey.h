@@ -38,14 +38,23 @@
 /// of the recording, determines the 'final key' by a majority decision. This
 /// final key is then emitted by this message to inform the other components
 /// of the software.
+///
+/// In the tuning mode the message is sent for every FFT. Then the
+/// SignalAnalyzer recycles the messages by an ObjectPool, filling a
+/// default-constructed message by setData(). releaseData() returns the key
+/// to its pool once all listeners have released the message.
 ///////////////////////////////////////////////////////////////////////////////
 
 class EPT_EXTERN MessageFinalKey : public Message
 {
 public:
+    MessageFinalKey();
     MessageFinalKey(int keyNumber, std::shared_ptr<Key> key);
     ~MessageFinalKey() {}
 
+    void setData(int keyNumber, std::shared_ptr<Key> key);
+    void releaseData();
+
     int getKeyNumber() { return mKeyNumber; }
     std::shared_ptr<Key> getFinalKey() const { return mKey; }
 
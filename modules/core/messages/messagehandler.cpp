@@ -21,6 +21,7 @@
 #include <assert.h>
 #include <algorithm>
 #include <iostream>
+#include <iterator>
 #include "messagelistener.h"
 
 
@@ -60,10 +61,10 @@ void MessageHandler::process()
     mMessageMutex.unlock();
 
     // handle messages
-    while (!list.empty())
+    for (MessagePtr &node : list)
     {
-        MessagePtr nextmessage (list.front());
-        list.pop_front();
+        MessagePtr nextmessage;
+        nextmessage.swap(node);
         for (auto listener : mListeners) {
             // check if listener is in remove list, then skip, because this listener is destroyed
             {
@@ -82,6 +83,11 @@ void MessageHandler::process()
             }
         }
     }
+
+    // recycle the emptied nodes of the queue
+    mMessageMutex.lock();
+    mFreeNodes.splice(mFreeNodes.end(), list);
+    mMessageMutex.unlock();
 }
 
 //----------------- Add a new listener to the messaging system -----------------
@@ -114,12 +120,20 @@ void MessageHandler::addMessage(MessagePtr message, bool dropOlder) {
     if (dropOlder) {
         for (auto it = mMessages.begin(); it != mMessages.end();) {
             if ((*it)->getType() == message->getType()) {
-                it = mMessages.erase(it);
+                auto next = std::next(it);
+                it->reset();
+                mFreeNodes.splice(mFreeNodes.end(), mMessages, it);
+                it = next;
             } else {
                 ++it;
             }
         }
     }
-    mMessages.push_back(message);
+    if (mFreeNodes.empty()) {
+        mMessages.push_back(message);
+    } else {
+        mFreeNodes.front() = message;
+        mMessages.splice(mMessages.end(), mFreeNodes, mFreeNodes.begin());
+    }
     mMessageMutex.unlock();
 }
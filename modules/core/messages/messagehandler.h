@@ -38,6 +38,9 @@
 /// This class adds messages of the different threads, places them
 /// in a queue and sends them to the connected listeners.
 ///
+/// The nodes of the queue are recycled, so that submitting a message
+/// does not allocate memory apart from the message itself.
+///
 /// This class is a singleton.
 /// Note that "process" has to be called in the thread of the GUI.
 //////////////////////////////////////////////////////////////////////////////
@@ -86,6 +89,7 @@ private:
     std::list<MessageListener*> mListenersToRemove;         ///< List of listeners to remove in the next frame
     mutable std::mutex mListenersChangesMutex;              ///< Mutex for accessing the listeners list
     std::list<MessagePtr> mMessages;                        ///< Queue of messages to be submitted
+    std::list<MessagePtr> mFreeNodes;                       ///< Recycled nodes of the queue
     mutable std::mutex mMessageMutex;                       ///< Mutex for accessing the queue
 };
 
@@ -19,6 +19,12 @@
 
 #include "messagenewfftcalculated.h"
 
+MessageNewFFTCalculated::MessageNewFFTCalculated() :
+    Message(MSG_NEW_FFT_CALCULATED),
+    mFFTMessageType(FFTMessageTypes::NewFFT),
+    mErrorType(FFTAnalyzerErrorTypes::ERR_NONE)
+{}
+
 MessageNewFFTCalculated::MessageNewFFTCalculated(FFTAnalyzerErrorTypes errorType) :
     Message(MSG_NEW_FFT_CALCULATED),
     mFFTMessageType(FFTMessageTypes::Error),
@@ -28,7 +34,7 @@ MessageNewFFTCalculated::MessageNewFFTCalculated(FFTAnalyzerErrorTypes errorType
 MessageNewFFTCalculated::MessageNewFFTCalculated(
         FFTMessageTypes type,
         FFTDataPointer fftdata,
-        std::shared_ptr<FFTPolygon> polygon) :
+        std::shared_ptr<const FFTPolygon> polygon) :
     Message(MSG_NEW_FFT_CALCULATED),
     mFFTMessageType(type),
     mFFTData(fftdata),
@@ -38,3 +44,28 @@ MessageNewFFTCalculated::MessageNewFFTCalculated(
 
 MessageNewFFTCalculated::~MessageNewFFTCalculated() {
 }
+
+void MessageNewFFTCalculated::setData(
+        FFTMessageTypes type,
+        FFTDataPointer fftdata,
+        std::shared_ptr<const FFTPolygon> polygon)
+{
+    mFFTMessageType = type;
+    mFFTData = fftdata;
+    mPolygon = polygon;
+    mErrorType = FFTAnalyzerErrorTypes::ERR_NONE;
+}
+
+void MessageNewFFTCalculated::setError(FFTAnalyzerErrorTypes errorType)
+{
+    mFFTMessageType = FFTMessageTypes::Error;
+    mFFTData.reset();
+    mPolygon.reset();
+    mErrorType = errorType;
+}
+
+void MessageNewFFTCalculated::releaseData()
+{
+    mFFTData.reset();
+    mPolygon.reset();
+}
@@ -28,10 +28,16 @@
 #include "../analyzers/fftanalyzererrorcodes.h"
 #include "../math/fftadapter.h"
 
-template class EPT_EXTERN std::shared_ptr<FFTPolygon>;
+template class EPT_EXTERN std::shared_ptr<const FFTPolygon>;
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Class of a message informing that a new FFT has been calculated
+///
+/// The SignalAnalyzer sends this message for every FFT. In order to avoid
+/// allocations, it recycles the messages by an ObjectPool: A default-
+/// constructed message is filled by setData(), and releaseData() returns
+/// the spectrum and the polygon to their pools once all listeners have
+/// released the message.
 ///////////////////////////////////////////////////////////////////////////////
 
 class EPT_EXTERN MessageNewFFTCalculated : public Message
@@ -45,21 +51,28 @@ public:
     };
 
 private:
-    const FFTMessageTypes mFFTMessageType;
+    FFTMessageTypes mFFTMessageType;
     FFTDataPointer mFFTData;
-    const std::shared_ptr<FFTPolygon> mPolygon;
+    std::shared_ptr<const FFTPolygon> mPolygon;
 
-    const FFTAnalyzerErrorTypes mErrorType;
+    FFTAnalyzerErrorTypes mErrorType;
 
 public:
+    MessageNewFFTCalculated();
     MessageNewFFTCalculated(FFTAnalyzerErrorTypes errorType);
     MessageNewFFTCalculated(FFTMessageTypes type,
                             FFTDataPointer fftdata,
-                            std::shared_ptr<FFTPolygon> polygon);
+                            std::shared_ptr<const FFTPolygon> polygon);
     virtual ~MessageNewFFTCalculated();
 
+    void setData(FFTMessageTypes type,
+                 FFTDataPointer fftdata,
+                 std::shared_ptr<const FFTPolygon> polygon);
+    void setError(FFTAnalyzerErrorTypes errorType);
+    void releaseData();
+
     FFTDataPointer getData() const { return mFFTData; }
-    std::shared_ptr<FFTPolygon> getPolygon() const { return mPolygon; }
+    std::shared_ptr<const FFTPolygon> getPolygon() const { return mPolygon; }
     FFTMessageTypes getFFTMessageType() const { return mFFTMessageType; }
     FFTAnalyzerErrorTypes getErrorType() const { return mErrorType; }
 
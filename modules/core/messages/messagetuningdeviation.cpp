@@ -19,9 +19,26 @@
 
 #include "messagetuningdeviation.h"
 
+MessageTuningDeviation::MessageTuningDeviation() :
+    Message(MSG_TUNING_DEVIATION),
+    mResult()
+{
+
+}
+
 MessageTuningDeviation::MessageTuningDeviation(FrequencyDetectionResult result) :
     Message(MSG_TUNING_DEVIATION),
     mResult(result)
 {
 
 }
+
+void MessageTuningDeviation::setData(FrequencyDetectionResult result)
+{
+    mResult = result;
+}
+
+void MessageTuningDeviation::releaseData()
+{
+    mResult.reset();
+}
@@ -29,14 +29,23 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief Message reporting a frequency deviation during tuning
+///
+/// The message is sent for every FFT in the tuning mode. The SignalAnalyzer
+/// recycles the messages by an ObjectPool, filling a default-constructed
+/// message by setData(). releaseData() returns the result to its pool once
+/// all listeners have released the message.
 ///////////////////////////////////////////////////////////////////////////////
 
 class EPT_EXTERN MessageTuningDeviation : public Message
 {
 public:
+    MessageTuningDeviation();
     MessageTuningDeviation(FrequencyDetectionResult result);
     ~MessageTuningDeviation() {}
 
+    void setData(FrequencyDetectionResult result);
+    void releaseData();
+
     FrequencyDetectionResult getResult() const {return mResult;}
 
 private:
@@ -27,7 +27,8 @@ std::unique_ptr<Settings> Settings::mSingleton;
 //                               Constructor
 //----------------------------------------------------------------------------
 
-Settings::Settings()
+Settings::Settings() :
+    mFFTSizePolicy(FFTSizePolicy::ZERO_PAD)
 {
     mSingleton.reset(this);
 }
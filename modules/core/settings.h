@@ -26,6 +26,7 @@
 
 #include "prerequisites.h"
 #include "audio/player/soundgenerator.h"
+#include "math/fftadapter.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 /// \brief The Settings class
@@ -71,6 +72,11 @@ public:
     /// Set flag indicating the stroboscopic mode of the tuning indicator
     virtual void setStroboscopeMode(bool enable) {mStroboscopeActive = enable;}
 
+    /// Get the policy for the length of the Fourier transforms
+    FFTSizePolicy getFFTSizePolicy() const {return mFFTSizePolicy;}
+    /// Set the policy for the length of the Fourier transforms
+    virtual void setFFTSizePolicy(FFTSizePolicy policy) {mFFTSizePolicy = policy;}
+
 protected:
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief Language Id
@@ -84,6 +90,7 @@ protected:
     bool mSoundGeneratorVolumeDynamic;                          ///< Flag for automatic volume adjustment
     bool mDisableAutomaticKeySelection;                         ///< Flag suppressing automatic key selection
     bool mStroboscopeActive;                                    ///< Flag indicating stroboscopic tuning indicator mode
+    FFTSizePolicy mFFTSizePolicy;                               ///< Policy for the length of the FFTs
 
 private:
     static std::unique_ptr<Settings> mSingleton;                ///< Singleton pointer
@@ -0,0 +1,132 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                    Pool of recycled shared objects
+//=============================================================================
+
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <atomic>
+
+#include "../prerequisites.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Pool of recycled objects shared by reference counting
+///
+/// Objects which are created for every FFT, e.g. the FFTData or the
+/// polygons for drawing, are passed by shared pointers to several modules
+/// and threads. Allocating them anew each time causes a considerable
+/// amount of heap traffic, since their buffers are large.
+///
+/// The pool keeps a shared pointer to each of its objects. An object is
+/// free if the pool holds the only reference, i.e., if all other users
+/// have released it. acquire() hands out a free object, which keeps the
+/// capacity of its buffers. Since the pointer is a copy of the one held
+/// by the pool, neither the object nor its control block is allocated.
+/// If all objects are in use and the pool is full, a new object is
+/// returned which is not recycled.
+///
+/// The caller is responsible for resetting the state of a recycled object.
+/// Objects which refer to other pooled objects can release these references
+/// as soon as they are free, see recycle().
+///
+/// This class contains of a header file only. There is no corresponding
+/// implementation (cpp) file.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+class ObjectPool
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Constructor
+    /// \param maximalSize : Maximal number of objects held by the pool
+    ///////////////////////////////////////////////////////////////////////////
+    explicit ObjectPool (size_t maximalSize = 8) :
+        mMaximalSize(maximalSize) {}
+
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Get a free object, creating one if none is available
+    /// \return Shared pointer to the object
+    ///////////////////////////////////////////////////////////////////////////
+    std::shared_ptr<T> acquire()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const std::shared_ptr<T> &object : mObjects)
+        {
+            // Only the pool can hand out new references, hence an object
+            // with a single reference stays free while the mutex is locked
+            if (object.use_count() == 1)
+            {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return object;
+            }
+        }
+        std::shared_ptr<T> object = std::make_shared<T>();
+        if (mObjects.size() < mMaximalSize)
+        {
+            if (mObjects.capacity() < mMaximalSize) mObjects.reserve(mMaximalSize);
+            mObjects.push_back(object);
+        }
+        return object;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Apply a function to all free objects
+    ///
+    /// Free objects keep their state until they are acquired again. If they
+    /// hold references to other pooled objects, these references can be
+    /// dropped here, so that the referenced objects become free as well.
+    /// \param function : Function called with a reference to each free object
+    ///////////////////////////////////////////////////////////////////////////
+    template <class Function>
+    void recycle (Function function)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const std::shared_ptr<T> &object : mObjects)
+        {
+            if (object.use_count() == 1)
+            {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                function(*object);
+            }
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    /// \brief Remove all objects, objects in use remain valid
+    ///////////////////////////////////////////////////////////////////////////
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mObjects.clear();
+    }
+
+private:
+    const size_t mMaximalSize;                      ///< Maximal number of pooled objects
+    std::mutex mMutex;                              ///< Mutex protecting the pool
+    std::vector<std::shared_ptr<T>> mObjects;       ///< Pooled objects
+};
+
+#endif // OBJECTPOOL_H
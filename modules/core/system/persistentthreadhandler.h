@@ -0,0 +1,285 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                       Persistent thread handler
+//=============================================================================
+
+#ifndef PERSISTENTTHREADHANDLER_H
+#define PERSISTENTTHREADHANDLER_H
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+
+#include "../prerequisites.h"
+#include "../system/log.h"
+#include "../system/eptexception.h"
+#include "simplethreadhandler.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Persistent thread handler processing jobs in a long-lived thread
+///
+/// The SimpleThreadHandler creates a new thread for each task. This is
+/// expensive if short tasks are started frequently, e.g. for each FFT.
+/// The persistent thread handler instead keeps a single worker thread
+/// alive which sleeps until a job is posted.
+///
+/// Jobs are passed through a mailbox with a single slot: If a job is
+/// posted while the worker is busy, it is stored as pending and processed
+/// next. If another job is posted in the meantime it replaces the pending
+/// one, i.e., the latest job wins and no job queue builds up.
+///
+/// <B>Usage:</B> Derive from PersistentThreadHandler<Job> and overload
+/// processJob() with the code to be executed within the thread. A long
+/// job should return when cancelThread() becomes true, which allows the
+/// CHECK_CANCEL_THREAD macro to be used as with the SimpleThreadHandler.
+/// The derived class has to call shutdown() in its destructor so that
+/// the thread is terminated before the derived part is destroyed.
+///
+/// This class contains of a header file only. There is no corresponding
+/// implementation (cpp) file.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Job>
+class PersistentThreadHandler
+{
+public:
+    PersistentThreadHandler(const std::string &threadName);
+    virtual ~PersistentThreadHandler();
+
+    void post(Job job);                     ///< Post a job, replacing a pending one
+    void cancel();                          ///< Cancel running and pending jobs, wait until idle
+    void shutdown();                        ///< Cancel all jobs and terminate the thread
+    bool isBusy() const;                    ///< True if a job is running or pending
+
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief Virtual job function, executed within the worker thread.
+    /// \param job : The job to be processed
+    ///////////////////////////////////////////////////////////////////////////////
+    virtual void processJob(Job &job) = 0;
+
+    bool cancelThread() const;              ///< True if the running job should stop
+
+private:
+    void threadFunction();                  // Function executed by the thread
+
+    const std::string mThreadName;          ///< Name of the thread for debugging
+    mutable std::mutex mMutex;              ///< Mutex protecting the mailbox and flags
+    std::condition_variable mCondition;     ///< Condition variable for sleeping and waiting
+    Job mPendingJob;                        ///< Single-slot mailbox
+    bool mHasPendingJob;                    ///< True if the mailbox holds a job
+    bool mBusy;                             ///< True while a job is processed
+    bool mCancel;                           ///< Cancel flag for the running job
+    bool mShutdown;                         ///< Flag terminating the thread
+    std::thread mThread;                    ///< The persistent worker thread
+};
+
+//=============================================================================
+//  Persistent thread handler implementation (contained in header because of template)
+//=============================================================================
+
+//-----------------------------------------------------------------------------
+//                        Constructor and destructor
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Constructor, not yet starting the thread. The thread is started when
+/// the first job is posted.
+/// \param threadName : Name of the thread shown in the debugger
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Job>
+PersistentThreadHandler<Job>::PersistentThreadHandler(const std::string &threadName)
+    : mThreadName(threadName),
+      mMutex(),
+      mCondition(),
+      mPendingJob(),
+      mHasPendingJob(false),
+      mBusy(false),
+      mCancel(false),
+      mShutdown(false),
+      mThread()
+{}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// Destructor, terminating the thread if the derived class did not do so.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Job>
+PersistentThreadHandler<Job>::~PersistentThreadHandler()
+{
+    shutdown();
+}
+
+
+//-----------------------------------------------------------------------------
+//                               Post a job
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Post a new job. If the worker is idle it starts immediately. Otherwise
+/// the job is stored in the mailbox, replacing a job which is still pending.
+/// The worker thread is created when the first job is posted.
+/// \param job : The job to be processed
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Job>
+void PersistentThreadHandler<Job>::post(Job job)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPendingJob = std::move(job);
+    mHasPendingJob = true;
+    mShutdown = false;
+    if (not mThread.joinable())
+        mThread = std::thread(&PersistentThreadHandler<Job>::threadFunction, this);
+    mCondition.notify_all();
+}
+
+
+//-----------------------------------------------------------------------------
+//                              Cancel all jobs
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Remove the pending job and mark the running job for cancellation.
+/// The function blocks until the running job has returned. The thread
+/// stays alive for further jobs.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Job>
+void PersistentThreadHandler<Job>::cancel()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mHasPendingJob = false;
+    mPendingJob = Job();
+    if (not mBusy) return;
+    mCancel = true;
+    mCondition.wait(lock, [this] { return not mBusy; });
+    mCancel = false;
+}
+
+
+//-----------------------------------------------------------------------------
+//                            Terminate the thread
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// Cancel all jobs, terminate the worker thread and wait for it.
+/// Posting a new job afterwards starts a new thread.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Job>
+void PersistentThreadHandler<Job>::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mHasPendingJob = false;
+        mPendingJob = Job();
+        mCancel = true;
+        mShutdown = true;
+        mCondition.notify_all();
+    }
+    if (mThread.joinable()) mThread.join();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCancel = false;
+}
+
+
+//-----------------------------------------------------------------------------
+//                              Query the state
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \return True if a job is running or pending.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Job>
+bool PersistentThreadHandler<Job>::isBusy() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBusy or mHasPendingJob;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \return True if the running job has been cancelled. A job which takes
+/// longer should check this flag regularly and return if it is set.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Job>
+bool PersistentThreadHandler<Job>::cancelThread() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCancel;
+}
+
+
+//-----------------------------------------------------------------------------
+//                         Function of the worker thread
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// The worker thread sleeps until a job is posted, takes it out of the
+/// mailbox and processes it. Exceptions are caught and logged in the same
+/// way as by the SimpleThreadHandler, so that the thread survives a failing
+/// job.
+///////////////////////////////////////////////////////////////////////////////
+
+template <class Job>
+void PersistentThreadHandler<Job>::threadFunction()
+{
+    SimpleThreadHandler::setThreadName(mThreadName);
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mBusy = false;
+            mCondition.notify_all();
+            mCondition.wait(lock, [this] { return mShutdown or mHasPendingJob; });
+            if (mShutdown) return;
+            job = std::move(mPendingJob);
+            mPendingJob = Job();
+            mHasPendingJob = false;
+            mBusy = true;
+        }
+
+        try
+        {
+            processJob(job);
+        }
+        catch (const EptException &e)
+        {
+            LogE("Worker thread job stopped with EptException: %s", e.what());
+        }
+        catch (const std::exception &e)
+        {
+            LogE("Worker thread job stopped with std::exception: %s", e.what());
+        }
+        catch (...) {
+            LogE("Worker thread job stopped with an unknown exception");
+        }
+    }
+}
+
+#endif // PERSISTENTTHREADHANDLER_H
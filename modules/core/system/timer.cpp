@@ -49,7 +49,7 @@ Timer::Timer()
 
 void Timer::reset ()
 {
-    mStart = std::chrono::system_clock::now();
+    mStart = Clock::now();
 }
 
 //-----------------------------------------------------------------------------
@@ -76,7 +76,7 @@ void Timer::wait(int milliseconds)
 
 int64_t Timer::getMilliseconds()
 {
-    auto now = std::chrono::system_clock::now();
+    auto now = Clock::now();
     return std::chrono::duration_cast<std::chrono::milliseconds>(now-mStart).count();
 }
 
@@ -106,12 +106,29 @@ bool Timer::timeout (int64_t milliseconds)
 /// \brief Wait in idle mode for a certain minimum time span since last reset.
 ///
 /// \param milliseconds : Mimimum waiting time in milliseconds.
-/// \param interval_ms : Checking interval in milliseconds, default = 5ms
 ///////////////////////////////////////////////////////////////////////////////
 
-void Timer::waitUntil (int64_t milliseconds, int interval_ms)
+void Timer::waitUntil (int64_t milliseconds)
 {
-    while (not timeout(milliseconds)) wait(interval_ms);
+    std::this_thread::sleep_until(getDeadline(milliseconds));
+}
+
+
+//-----------------------------------------------------------------------------
+//            Point in time a certain time span after last reset
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Get the point in time a certain time span after the last reset.
+///
+/// \param milliseconds : Time span in milliseconds.
+/// \return Point in time which can be passed to functions waiting for
+/// events with a deadline.
+///////////////////////////////////////////////////////////////////////////////
+
+Timer::TimePoint Timer::getDeadline (int64_t milliseconds) const
+{
+    return mStart + std::chrono::milliseconds(milliseconds);
 }
 
 
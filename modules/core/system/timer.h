@@ -32,13 +32,21 @@
 /// This timer works like a simple clock which is set to zero at the moment
 /// of creation and whenever the function reset() is called. The class
 /// provides a function waitUntil which waits for a certain minimum time
-/// span since the last reset. It is used in the SignalAnalyzer in order
-/// to compute FFTs with a certain mininum time interval in between.
+/// span since the last reset, and a function getDeadline which returns
+/// the corresponding point in time for waiting on other events. It is used
+/// in the SignalAnalyzer in order to compute FFTs with a certain mininum
+/// time interval in between.
+///
+/// The timer is based on a monotonic clock which is not affected by
+/// adjustments of the system time.
 ///////////////////////////////////////////////////////////////////////////////
 
 class Timer
 {
 public:
+    using Clock = std::chrono::steady_clock;    ///< Monotonic clock
+    using TimePoint = Clock::time_point;        ///< Point in time
+
     Timer();
     ~Timer() {}
 
@@ -46,10 +54,11 @@ public:
     int64_t getMilliseconds();
     void wait (int milliseconds);
     bool timeout (int64_t milliseconds);
-    void waitUntil (int64_t milliseconds, int interval_ms=5);
+    void waitUntil (int64_t milliseconds);
+    TimePoint getDeadline (int64_t milliseconds) const;
 
 private:
-    std::chrono::time_point<std::chrono::system_clock> mStart;
+    TimePoint mStart;
 };
 
 #endif // TIMER_H
@@ -0,0 +1,80 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                     Wakeup event for waiting threads
+//=============================================================================
+
+#include "wakeupevent.h"
+
+//-----------------------------------------------------------------------------
+//                              Constructor
+//-----------------------------------------------------------------------------
+
+/// Constructor, creating an event which is not signaled
+
+WakeupEvent::WakeupEvent() :
+    mMutex(),
+    mCondition(),
+    mSignaled(false)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+//                          Wake up the waiting thread
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Signal the event and wake up the waiting thread.
+///
+/// This function never blocks. If the mutex is free, taking it once makes
+/// sure that the waiting thread is not between checking the flag and
+/// falling asleep, so that the notification cannot get lost.
+///////////////////////////////////////////////////////////////////////////////
+
+void WakeupEvent::notify ()
+{
+    mSignaled.store(true);
+    {
+        std::unique_lock<std::mutex> lock(mMutex, std::try_to_lock);
+    }
+    mCondition.notify_one();
+}
+
+
+//-----------------------------------------------------------------------------
+//                          Wait for the event
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Sleep until the event is signaled or the deadline has passed.
+///
+/// If the event was signaled before, the function returns immediately.
+/// The event is reset before returning.
+/// \param deadline : Point in time at which the function returns at the latest
+/// \return true if the event was signaled, false on timeout
+///////////////////////////////////////////////////////////////////////////////
+
+bool WakeupEvent::waitUntil (Clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait_until(lock, deadline, [this] { return mSignaled.load(); });
+    return mSignaled.exchange(false);
+}
@@ -0,0 +1,63 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//                     Wakeup event for waiting threads
+//=============================================================================
+
+#ifndef WAKEUPEVENT_H
+#define WAKEUPEVENT_H
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include "prerequisites.h"
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Event on which a thread can sleep until another thread wakes it up.
+///
+/// A single thread waits by calling waitUntil() with a deadline. Any other
+/// thread, including the real-time audio thread, can wake it up by calling
+/// notify(). The notifying thread never blocks: It does not wait for the
+/// mutex of the condition variable but only tries to take it. In the
+/// unlikely case that the mutex is held by the waiting thread at this
+/// moment, the wakeup may be delayed until the deadline of the waiting
+/// thread, but it is never lost permanently.
+///////////////////////////////////////////////////////////////////////////////
+
+class EPT_EXTERN WakeupEvent
+{
+public:
+    using Clock = std::chrono::steady_clock;    ///< Monotonic clock for deadlines
+
+    WakeupEvent();
+    ~WakeupEvent() {}
+
+    void notify ();
+    bool waitUntil (Clock::time_point deadline);
+
+private:
+    std::mutex mMutex;                          ///< Mutex of the condition variable
+    std::condition_variable mCondition;         ///< Condition variable for sleeping
+    std::atomic<bool> mSignaled;                ///< Flag set by notify()
+};
+
+#endif // WAKEUPEVENT_H
@@ -0,0 +1,32 @@
+include(../../entropypianotuner_config.pri)
+include(../../entropypianotuner_func.pri)
+
+# Test of the single-precision rolling FFT against double precision,
+# run by "make check"
+TEMPLATE = app
+TARGET = fftprecisiontest
+
+QT -= gui
+CONFIG += console c++14 testcase
+CONFIG -= app_bundle
+
+# next to the core library
+DESTDIR = $$EPT_TARGET_OUT_DIR
+unix:QMAKE_RPATHDIR += $$EPT_CORE_OUT_DIR
+
+INCLUDEPATH += $$EPT_BASE_DIR $$EPT_MODULES_DIR $$EPT_CORE_DIR
+INCLUDEPATH += $$EPT_THIRDPARTY_DIR/tp3log
+
+# same order as for the app
+contains(EPT_THIRDPARTY_CONFIG, system_fftw3) {
+    $$depends_core()
+    $$depends_fftw3()
+} else {
+    $$depends_fftw3()
+    $$depends_core()
+}
+$$depends_getmemorysize()
+$$depends_libuv()
+$$depends_timesupport()
+
+SOURCES += fftprecisiontest.cpp
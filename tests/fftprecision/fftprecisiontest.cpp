@@ -0,0 +1,244 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//       Test of the single-precision rolling FFT against double precision
+//=============================================================================
+
+///////////////////////////////////////////////////////////////////////////////
+/// In the tuning mode the rolling FFTs are carried out in single precision.
+/// This test checks that this does not change the result that matters,
+/// namely the tuning deviation detected by the FFTAnalyzer. A synthetic
+/// piano tone, detuned by a few cents, is generated at the reduced sampling
+/// rate and with the window length used by the SignalAnalyzer. Its spectrum
+/// is computed in single and in double precision and passed to
+/// FFTAnalyzer::detectFrequencyOfKnownKey(). Both results have to agree
+/// within a small fraction of a cent. As a check of the setup, the
+/// double-precision result has to reproduce the detuning within the
+/// resolution of the short window.
+///
+/// Keys across the keyboard are tested, once without a recorded spectrum
+/// (magnified peak) and once after recording the key (kernel correlation).
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "settings.h"
+#include "analyzers/fftanalyzer.h"
+#include "math/decimator.h"
+#include "math/fftimplementation.h"
+#include "math/mathtools.h"
+#include "piano/piano.h"
+
+//-----------------------------------------------------------------------------
+//                             Test class
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Comparison of the tuning deviations detected in the spectra of
+/// the single- and the double-precision FFT
+///////////////////////////////////////////////////////////////////////////////
+
+class FFTPrecisionTest
+{
+public:
+    static const int SAMPLING_RATE = 44100;     ///< Sampling rate of the recording
+    static const double DETUNING;               ///< Detuning of the test tone in cents
+    static const double PRECISION_TOLERANCE;    ///< Allowed float/double difference in cents
+    static const double DETECTION_TOLERANCE;    ///< Allowed error of the detected detuning in cents
+
+    FFTPrecisionTest();
+
+    bool recordKey (int keyIndex);
+    bool run (int keyIndex);
+
+private:
+    void synthesize (int keyIndex, double frequency, int samplingRate, double time, FFTWVector &signal) const;
+    FFTDataPointer transform (FFTAdapter &fft, const FFTWVector &signal, int samplingRate) const;
+
+    Piano mPiano;                               ///< Piano with equal temperament
+    FFTAnalyzer mAnalyzer;                      ///< The FFTAnalyzer evaluating the spectra
+    FFT_Implementation mFFT;                    ///< Double-precision FFT
+    FFT_ImplementationFloat mFFTFloat;          ///< Single-precision FFT of the rolling window
+};
+
+const double FFTPrecisionTest::DETUNING = 3.7;
+const double FFTPrecisionTest::PRECISION_TOLERANCE = 0.05;
+const double FFTPrecisionTest::DETECTION_TOLERANCE = 2;
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Constructor, the piano is tuned to equal temperament
+///////////////////////////////////////////////////////////////////////////////
+
+FFTPrecisionTest::FFTPrecisionTest() :
+    mPiano(),
+    mAnalyzer(),
+    mFFT(),
+    mFFTFloat()
+{
+    for (int k = 0; k < mPiano.getKeyboard().getNumberOfKeys(); ++k)
+        mPiano.getKey(k).setComputedFrequency(mPiano.getEqualTempFrequency(k));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Synthesize a decaying piano tone with inharmonic partials.
+///
+/// The frequency of the first partial is given, as it is determined by
+/// the FFTAnalyzer.
+/// \param keyIndex : Index of the key
+/// \param frequency : Frequency of the first partial
+/// \param samplingRate : Sampling rate of the signal
+/// \param time : Duration in seconds
+/// \param signal : The generated signal
+///////////////////////////////////////////////////////////////////////////////
+
+void FFTPrecisionTest::synthesize (int keyIndex, double frequency, int samplingRate,
+                                   double time, FFTWVector &signal) const
+{
+    const double B = mPiano.getExpectedInharmonicity(mPiano.getEqualTempFrequency(keyIndex));
+    signal.assign(static_cast<size_t>(samplingRate * time), 0);
+    for (int n = 1; n <= 16; ++n)
+    {
+        const double fn = n * frequency * std::sqrt((1 + B * n * n) / (1 + B));
+        if (fn > 0.4 * samplingRate) break;
+        const double amplitude = 0.2 / n;
+        for (size_t i = 0; i < signal.size(); ++i)
+        {
+            const double t = static_cast<double>(i) / samplingRate;
+            signal[i] += amplitude * std::exp(-t / 2) * std::sin(MathTools::TWO_PI * fn * t);
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compute the power spectrum of a signal.
+/// \param fft : FFT implementation
+/// \param signal : The signal
+/// \param samplingRate : Its sampling rate
+/// \return The power spectrum
+///////////////////////////////////////////////////////////////////////////////
+
+FFTDataPointer FFTPrecisionTest::transform (FFTAdapter &fft, const FFTWVector &signal,
+                                            int samplingRate) const
+{
+    FFTDataPointer data = std::make_shared<FFTData>();
+    data->samplingRate = samplingRate;
+    fft.calculatePowerSpectrum(signal, data->fft);
+    return data;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Record a key as in the recording mode: The complete keystroke
+/// is transformed in double precision and analysed by the FFTAnalyzer.
+/// \param keyIndex : Index of the key
+/// \return True on success
+///////////////////////////////////////////////////////////////////////////////
+
+bool FFTPrecisionTest::recordKey (int keyIndex)
+{
+    FFTWVector signal;
+    synthesize(keyIndex, mPiano.getEqualTempFrequency(keyIndex), SAMPLING_RATE, 6, signal);
+    auto result = mAnalyzer.analyse(&mPiano, transform(mFFT, signal, SAMPLING_RATE), keyIndex);
+    if (result.first != FFTAnalyzerErrorTypes::ERR_NONE or not result.second)
+    {
+        std::cout << "FAIL: key " << keyIndex << " could not be recorded" << std::endl;
+        return false;
+    }
+    Key &key = mPiano.getKey(keyIndex);
+    const double computedFrequency = key.getComputedFrequency();
+    key = *result.second;
+    key.setComputedFrequency(computedFrequency);
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Compare the detected tuning deviations of a key.
+///
+/// The length of the window and the reduced sampling rate are chosen as
+/// in SignalAnalyzer::updateDataBufferSize().
+/// \param keyIndex : Index of the key
+/// \return True if float and double agree and the detuning is detected
+///////////////////////////////////////////////////////////////////////////////
+
+bool FFTPrecisionTest::run (int keyIndex)
+{
+    const Key &key = mPiano.getKey(keyIndex);
+    const int globalKey = keyIndex + 48 - mPiano.getKeyboard().getKeyNumberOfA4();
+    const double time = (0.5 - 3.0) * globalKey / 88 + 3.0;
+    const int factor = Decimator::selectFactor(SAMPLING_RATE,
+                       mAnalyzer.getRequiredBandwidth(&mPiano, key, keyIndex));
+    const int samplingRate = SAMPLING_RATE / factor;
+
+    const double frequency = mPiano.getEqualTempFrequency(keyIndex) * std::pow(2.0, DETUNING / 1200);
+    FFTWVector signal;
+    synthesize(keyIndex, frequency, samplingRate, time, signal);
+
+    FrequencyDetectionResult reference = mAnalyzer.detectFrequencyOfKnownKey(
+                transform(mFFT, signal, samplingRate), &mPiano, key, keyIndex);
+    FrequencyDetectionResult approximation = mAnalyzer.detectFrequencyOfKnownKey(
+                transform(mFFTFloat, signal, samplingRate), &mPiano, key, keyIndex);
+
+    const char *method = (key.isRecorded() ? "recorded" : "not recorded");
+    if (reference->error != FFTAnalyzerErrorTypes::ERR_NONE or
+        approximation->error != FFTAnalyzerErrorTypes::ERR_NONE)
+    {
+        std::cout << "FAIL: key " << keyIndex << " (" << method << "): no frequency detected" << std::endl;
+        return false;
+    }
+
+    const double difference = reference->positionOfMaximum - approximation->positionOfMaximum;
+    const double detected = 1200 * std::log2(reference->detectedFrequency / frequency);
+    const bool success = std::abs(difference) <= PRECISION_TOLERANCE and
+                         std::abs(detected) <= DETECTION_TOLERANCE;
+    std::cout << (success ? "PASS: " : "FAIL: ") << "key " << keyIndex << " (" << method
+              << "), decimation " << factor << ": float - double = " << difference
+              << " cents, error of the detected frequency " << detected << " cents" << std::endl;
+    return success;
+}
+
+
+//-----------------------------------------------------------------------------
+//                                  Main
+//-----------------------------------------------------------------------------
+
+int main()
+{
+    // The settings register themselves as singleton
+    new Settings();
+
+    FFTPrecisionTest test;
+    bool success = true;
+    for (int keyIndex : {12, 24, 36, 48, 60, 72})
+    {
+        success = test.run(keyIndex) and success;
+        success = test.recordKey(keyIndex) and test.run(keyIndex) and success;
+    }
+#ifndef EPT_FFTW3F
+    std::cout << "Note: Built without fftw3f, both transformations are in double precision." << std::endl;
+#endif
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
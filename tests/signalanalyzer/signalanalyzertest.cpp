@@ -0,0 +1,298 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//=============================================================================
+//          Test of the heap allocations per FFT of the SignalAnalyzer
+//=============================================================================
+
+///////////////////////////////////////////////////////////////////////////////
+/// This test feeds a steady tone into the SignalAnalyzer, tick by tick as
+/// the recording thread does, and counts the calls of the global operator
+/// new. After a warm-up, in which the pools, caches and buffers reach their
+/// final size, an FFT tick must not allocate any memory. This is checked
+/// in the recording mode (incremental spectrum, key recognition) and in
+/// the tuning mode (decimation, rolling FFT).
+///
+/// Only the allocations of the thread carrying out the tick are counted.
+/// The KeyRecognizer works in its own thread, and the messages are
+/// processed here in between the ticks, as it is done by the GUI. In the
+/// tuning mode each tick includes the evaluation of the spectrum by the
+/// FFTAnalyzer, which has to report a tuning deviation for every tick.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "settings.h"
+#include "analyzers/signalanalyzer.h"
+#include "audio/audiointerface.h"
+#include "audio/recorder/audiorecorder.h"
+#include "messages/messagehandler.h"
+#include "messages/messagelistener.h"
+#include "messages/messagetuningdeviation.h"
+#include "piano/piano.h"
+#include "math/mathtools.h"
+
+//-----------------------------------------------------------------------------
+//                          Counting allocator
+//-----------------------------------------------------------------------------
+
+namespace
+{
+    thread_local bool countAllocations = false;     ///< Counting enabled in this thread
+    thread_local size_t numberOfAllocations = 0;    ///< Allocations of this thread
+}
+
+void *operator new (std::size_t size)
+{
+    if (countAllocations) ++numberOfAllocations;
+    if (void *pointer = std::malloc(size > 0 ? size : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete (void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete (void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+
+//-----------------------------------------------------------------------------
+//                             Test class
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Test driving the SignalAnalyzer, acting as its audio interface
+///////////////////////////////////////////////////////////////////////////////
+
+class SignalAnalyzerTest : private AudioInterface, private MessageListener
+{
+public:
+    static const int SAMPLING_RATE = 44100;     ///< Sampling rate of the test signal
+    static const int KEY = 48;                  ///< Key of the test signal (A4)
+    static const int WARMUP_TICKS = 80;         ///< Ticks before counting, 12 seconds
+    static const int MEASURED_TICKS = 40;       ///< Ticks with counted allocations
+
+    SignalAnalyzerTest();
+    ~SignalAnalyzerTest() { mRecorder.close(); }
+
+    bool checkCounter();
+    bool run (const char *name, bool recording);
+
+private:
+    // Implementation of the audio interface
+    void init() override {}
+    void exit() override {}
+    void start() override {}
+    void stop() override {}
+    const std::string getDeviceName() const override { return "Test signal"; }
+    int getSamplingRate() const override { return SAMPLING_RATE; }
+    int getChannelCount() const override { return 1; }
+    PCMDevice *getDevice() const override { return nullptr; }
+    void setDevice(PCMDevice *) override {}
+    void setGain(double) override {}
+    double getGain() const override { return 1; }
+    void suspendChanged(bool) override {}
+
+    void handleMessage (MessagePtr m) override;
+    void prepare (bool recording);
+    size_t tick();
+
+    Piano mPiano;                               ///< Default piano
+    AudioRecorder mRecorder;                    ///< Recorder opened on this interface
+    SignalAnalyzer mAnalyzer;                   ///< The tested analyzer
+    std::vector<double> mSamples;               ///< Samples of a single tick
+    size_t mTime;                               ///< Number of generated samples
+    int mDeviations;                            ///< Number of detected tuning deviations
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Constructor, initializing the analyzer
+///////////////////////////////////////////////////////////////////////////////
+
+SignalAnalyzerTest::SignalAnalyzerTest() :
+    mPiano(),
+    mRecorder(),
+    mAnalyzer(&mRecorder),
+    mSamples(SAMPLING_RATE * SignalAnalyzer::MINIMAL_FFT_INTERVAL_IN_MILLISECONDS / 1000),
+    mTime(0),
+    mDeviations(0)
+{
+    for (int k = 0; k < mPiano.getKeyboard().getNumberOfKeys(); ++k)
+        mPiano.getKey(k).setComputedFrequency(mPiano.getEqualTempFrequency(k));
+    mRecorder.open(this);
+    mAnalyzer.mKeyRecognizer.init(false);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Check that allocations within the core library are counted.
+///
+/// If the core is a shared library with its own heap (MSVC), the
+/// replacement of the operator new does not apply to it.
+/// \return True if the counter works
+///////////////////////////////////////////////////////////////////////////////
+
+bool SignalAnalyzerTest::checkCounter()
+{
+    numberOfAllocations = 0;
+    countAllocations = true;
+    {
+        Piano piano;
+    }
+    countAllocations = false;
+    if (numberOfAllocations > 0) return true;
+    std::cout << "FAIL: Allocations of the core library cannot be counted." << std::endl;
+    return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Count the tuning deviations detected without error.
+/// \param m : Message sent by the analyzer
+///////////////////////////////////////////////////////////////////////////////
+
+void SignalAnalyzerTest::handleMessage (MessagePtr m)
+{
+    if (m->getType() != Message::MSG_TUNING_DEVIATION) return;
+    auto message(std::static_pointer_cast<MessageTuningDeviation>(m));
+    if (not message->getResult()->hasError()) ++mDeviations;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Put the analyzer into the given mode, as done at the beginning
+/// of SignalAnalyzer::recordSignal().
+/// \param recording : True for the recording mode, false for the tuning mode
+///////////////////////////////////////////////////////////////////////////////
+
+void SignalAnalyzerTest::prepare (bool recording)
+{
+    mAnalyzer.mPiano = &mPiano;
+    mAnalyzer.mSelectedKey = KEY;
+    // in the tuning mode the key is selected by the user
+    mAnalyzer.mKeyForced = not recording;
+    mAnalyzer.mAnalyzerRole = (recording ? SignalAnalyzer::ROLE_RECORD_KEYSTROKE
+                                         : SignalAnalyzer::ROLE_ROLLING_FFT);
+    mAnalyzer.updateDataBufferSize();
+    {
+        std::lock_guard<std::mutex> lock(mAnalyzer.mKeyCountStatisticsMutex);
+        mAnalyzer.mKeyCountStatistics.clear();
+        mAnalyzer.mConfidentKey = -1;
+        mAnalyzer.mConfidentRecognitions = 0;
+        mAnalyzer.mEarlyDecisionKey = -1;
+    }
+    if (recording) mAnalyzer.mSpectrumAccumulator.reset(SAMPLING_RATE, mAnalyzer.getSegmentSize());
+    mAnalyzer.mRecording = true;
+    mTime = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Carry out a single tick: New samples arrive in two spans,
+/// the spectrum is computed and processed as in the recording thread.
+/// \return Number of allocations during the tick
+///////////////////////////////////////////////////////////////////////////////
+
+size_t SignalAnalyzerTest::tick()
+{
+    // steady tone with a few partials
+    const double f = mPiano.getEqualTempFrequency(KEY);
+    for (double &y : mSamples)
+    {
+        const double t = static_cast<double>(mTime++) / SAMPLING_RATE;
+        y = 0;
+        for (int n = 1; n <= 4; ++n) y += 0.2 / n * std::sin(MathTools::TWO_PI * n * f * t);
+    }
+    const size_t half = mSamples.size() / 2;
+
+    numberOfAllocations = 0;
+    countAllocations = true;
+    {
+        std::lock_guard<std::mutex> lock(mAnalyzer.mDataBufferMutex);
+        mAnalyzer.appendSamples(mSamples.data(), half);
+        mAnalyzer.appendSamples(mSamples.data() + half, mSamples.size() - half);
+        if (mAnalyzer.transformData()) mAnalyzer.powerspectrumProcessing();
+    }
+    countAllocations = false;
+
+    // let the KeyRecognizer finish and deliver the messages
+    while (mAnalyzer.mKeyRecognizer.isBusy())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    MessageHandler::getSingleton().process();
+    return numberOfAllocations;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Run the test in a given mode.
+/// \param name : Name of the mode for the output
+/// \param recording : True for the recording mode, false for the tuning mode
+/// \return True if no allocations occurred after the warm-up and, in the
+/// tuning mode, a tuning deviation was detected in every tick
+///////////////////////////////////////////////////////////////////////////////
+
+bool SignalAnalyzerTest::run (const char *name, bool recording)
+{
+    prepare(recording);
+    for (int i = 0; i < WARMUP_TICKS; ++i) tick();
+    size_t allocations = 0;
+    mDeviations = 0;
+    for (int i = 0; i < MEASURED_TICKS; ++i) allocations += tick();
+    mAnalyzer.mKeyRecognizer.cancel();
+    mAnalyzer.mRecording = false;
+
+    const bool success = allocations == 0 and (recording or mDeviations == MEASURED_TICKS);
+    std::cout << (success ? "PASS: " : "FAIL: ") << name << ": "
+              << allocations << " allocations in " << MEASURED_TICKS << " ticks";
+    if (not recording) std::cout << ", " << mDeviations << " tuning deviations";
+    std::cout << std::endl;
+    return success;
+}
+
+
+//-----------------------------------------------------------------------------
+//                                  Main
+//-----------------------------------------------------------------------------
+
+int main()
+{
+    // The settings register themselves as singleton. Changes of the
+    // selected key are events, not part of the steady state.
+    new Settings();
+    Settings::getSingleton().setDisableAutomaticKeySelection(true);
+
+    SignalAnalyzerTest test;
+    bool success = test.checkCounter();
+    success = test.run("recording mode", true) and success;
+    success = test.run("tuning mode", false) and success;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
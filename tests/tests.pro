@@ -0,0 +1,11 @@
+#-------------------------------------------------
+#                  EPT TESTS
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    fftprecision \
+    signalanalyzer \
+    wakeuplatency \
+
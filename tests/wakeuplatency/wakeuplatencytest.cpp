@@ -0,0 +1,201 @@
+/*****************************************************************************
+ * Copyright 2018 Haye Hinrichsen, Christoph Wick
+ *
+ * This file is part of Entropy Piano Tuner.
+ *
+ * Entropy Piano Tuner is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * Entropy Piano Tuner is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Entropy Piano Tuner. If not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+//=============================================================================
+//          Test of the wakeup latency of AudioRecorder::waitForData
+//=============================================================================
+
+///////////////////////////////////////////////////////////////////////////////
+/// An audio thread writes packets of 10 ms into the AudioRecorder, as the
+/// audio device does. The reading thread waits for a few packets in
+/// waitForData() with the deadline used by the SignalAnalyzer. The latency
+/// is the time from the moment the requested data is complete until the
+/// reading thread is awake.
+///
+/// Before the wakeup by events, the SignalAnalyzer polled the buffer every
+/// 50 ms, i.e., with a latency of 25 ms on average and 50 ms at worst.
+/// The median latency has to be far below that. Since the audio thread
+/// never blocks, a wakeup can be delayed up to the deadline in rare cases,
+/// so that the maximum must not exceed MAXIMAL_WAIT_IN_MILLISECONDS, up to
+/// the scheduling tolerance of the system.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "settings.h"
+#include "analyzers/signalanalyzer.h"
+#include "audio/audiointerface.h"
+#include "audio/recorder/audiorecorder.h"
+
+//-----------------------------------------------------------------------------
+//                             Test class
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Test of the wakeup latency, acting as the audio interface
+///////////////////////////////////////////////////////////////////////////////
+
+class WakeupLatencyTest : private AudioInterface
+{
+public:
+    using Clock = WakeupEvent::Clock;           ///< Clock of the deadlines
+
+    static const int SAMPLING_RATE = 44100;     ///< Sampling rate of the audio thread
+    static const int PACKET_SIZE = 441;         ///< Samples per packet, 10 ms
+    static const int PACKETS_PER_WAIT = 3;      ///< Packets awaited by the reading thread
+    static const int NUMBER_OF_WAITS = 300;     ///< Number of measured waits
+    static const int MEDIAN_LIMIT_IN_MILLISECONDS = 5;      ///< Limit of the median latency
+    static const int SCHEDULING_TOLERANCE_IN_MILLISECONDS = 10; ///< Tolerance of the maximum
+
+    WakeupLatencyTest();
+    ~WakeupLatencyTest() { mRecorder.close(); }
+
+    bool run();
+
+private:
+    // Implementation of the audio interface
+    void init() override {}
+    void exit() override {}
+    void start() override {}
+    void stop() override {}
+    const std::string getDeviceName() const override { return "Test signal"; }
+    int getSamplingRate() const override { return SAMPLING_RATE; }
+    int getChannelCount() const override { return 1; }
+    PCMDevice *getDevice() const override { return nullptr; }
+    void setDevice(PCMDevice *) override {}
+    void setGain(double) override {}
+    double getGain() const override { return 1; }
+    void suspendChanged(bool) override {}
+
+    void audioThread();
+
+    AudioRecorder mRecorder;                    ///< Recorder opened on this interface
+    std::atomic<bool> mRunning;                 ///< The audio thread is running
+    std::atomic<size_t> mRequested;             ///< Amount of data awaited by the reader
+    std::atomic<Clock::rep> mCompleted;         ///< Time at which the awaited data was complete
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Constructor, opening the recorder
+///////////////////////////////////////////////////////////////////////////////
+
+WakeupLatencyTest::WakeupLatencyTest() :
+    mRecorder(),
+    mRunning(false),
+    mRequested(AudioRecorder::NO_WAKEUP),
+    mCompleted(0)
+{
+    mRecorder.open(this);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Audio thread, writing a packet of silence every 10 ms and
+/// recording the time at which the packet completing the data awaited by
+/// the reader is written.
+///////////////////////////////////////////////////////////////////////////////
+
+void WakeupLatencyTest::audioThread()
+{
+    const std::vector<PCMDevice::DataType> packet(PACKET_SIZE, 0);
+    PCMDevice &device = mRecorder;
+    Clock::time_point next = Clock::now();
+    while (mRunning)
+    {
+        next += std::chrono::milliseconds(1000 * PACKET_SIZE / SAMPLING_RATE);
+        std::this_thread::sleep_until(next);
+        // the awaited data is complete with this packet
+        const size_t requested = mRequested;
+        const size_t buffered = mRecorder.readData().size();
+        const Clock::time_point time = Clock::now();
+        device.write(reinterpret_cast<const char *>(packet.data()),
+                     packet.size() * sizeof(PCMDevice::DataType));
+        if (buffered < requested and buffered + PACKET_SIZE >= requested)
+            mCompleted = time.time_since_epoch().count();
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief Measure the latencies and check their median and maximum.
+/// \return True if the latencies are within the limits
+///////////////////////////////////////////////////////////////////////////////
+
+bool WakeupLatencyTest::run()
+{
+    mRunning = true;
+    std::thread audio(&WakeupLatencyTest::audioThread, this);
+
+    std::vector<double> latencies;
+    for (int i = 0; i < NUMBER_OF_WAITS; ++i)
+    {
+        mRecorder.clearData();
+        mCompleted = 0;
+        mRequested = PACKETS_PER_WAIT * PACKET_SIZE;
+        const Clock::time_point deadline = Clock::now() +
+                std::chrono::milliseconds(SignalAnalyzer::MAXIMAL_WAIT_IN_MILLISECONDS);
+        const bool available = mRecorder.waitForData(mRequested, deadline);
+        const Clock::time_point awake = Clock::now();
+        mRequested = AudioRecorder::NO_WAKEUP;
+
+        // The deadline may have passed before the data was complete
+        if (not available) continue;
+        while (mCompleted == 0) std::this_thread::yield();
+        const Clock::time_point completed{Clock::duration(mCompleted.load())};
+        latencies.push_back(std::max(0.0, std::chrono::duration<double, std::milli>(awake - completed).count()));
+    }
+    mRunning = false;
+    audio.join();
+
+    if (latencies.empty())
+    {
+        std::cout << "FAIL: no data arrived" << std::endl;
+        return false;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const double median = latencies[latencies.size() / 2];
+    const double percentile = latencies[latencies.size() * 99 / 100];
+    const double maximum = latencies.back();
+    const bool success = median <= MEDIAN_LIMIT_IN_MILLISECONDS and
+            maximum <= SignalAnalyzer::MAXIMAL_WAIT_IN_MILLISECONDS + SCHEDULING_TOLERANCE_IN_MILLISECONDS;
+    std::cout << (success ? "PASS: " : "FAIL: ") << latencies.size() << " wakeups, latency median "
+              << median << " ms, 99% " << percentile << " ms, maximum " << maximum << " ms" << std::endl;
+    return success;
+}
+
+
+//-----------------------------------------------------------------------------
+//                                  Main
+//-----------------------------------------------------------------------------
+
+int main()
+{
+    // The settings register themselves as singleton
+    new Settings();
+
+    WakeupLatencyTest test;
+    return test.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+}